@@ -0,0 +1,405 @@
+#include "CorpusGenerator.h"
+#include <zip.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string_view>
+
+std::vector<CorpusSpec> defaultCorpus()
+{
+    std::vector<CorpusSpec> corpus;
+
+    CorpusSpec spec;
+    spec.name = "plain-200";
+    spec.paragraphs = 200;
+    corpus.push_back(spec);
+
+    spec = CorpusSpec();
+    spec.name = "plain-5000";
+    spec.paragraphs = 5000;
+    corpus.push_back(spec);
+
+    spec = CorpusSpec();
+    spec.name = "runs-dense";
+    spec.paragraphs = 500;
+    spec.runsPerParagraph = 40;
+    spec.wordsPerRun = 3;
+    corpus.push_back(spec);
+
+    spec = CorpusSpec();
+    spec.name = "font-mix";
+    spec.paragraphs = 1000;
+    spec.runsPerParagraph = 8;
+    spec.wordsPerRun = 6;
+    spec.fontSizes = 8;
+    corpus.push_back(spec);
+
+    spec = CorpusSpec();
+    spec.name = "tables-small";
+    spec.paragraphs = 100;
+    spec.tables = 50;
+    spec.tableRows = 6;
+    spec.tableCols = 4;
+    corpus.push_back(spec);
+
+    spec = CorpusSpec();
+    spec.name = "tables-large-spans";
+    spec.paragraphs = 20;
+    spec.tables = 4;
+    spec.tableRows = 400;
+    spec.tableCols = 8;
+    spec.spanEvery = 3;
+    spec.fontSizes = 3;
+    corpus.push_back(spec);
+
+    spec = CorpusSpec();
+    spec.name = "media-small";
+    spec.paragraphs = 200;
+    spec.images = 40;
+    spec.imageBytes = 32 * 1024;
+    corpus.push_back(spec);
+
+    spec = CorpusSpec();
+    spec.name = "media-large";
+    spec.paragraphs = 50;
+    spec.images = 8;
+    spec.imageBytes = 1024 * 1024;
+    corpus.push_back(spec);
+
+    return corpus;
+}
+
+namespace
+{
+// xorshift32, only needs to be deterministic
+class Random
+{
+public:
+    explicit Random(uint32_t seed) : state_(seed ? seed : 1) {}
+
+    uint32_t next()
+    {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+    int below(int n) { return static_cast<int>(next() % static_cast<uint32_t>(n)); }
+
+private:
+    uint32_t state_;
+};
+
+// Mixed lengths, some non-ASCII and one that needs escaping
+const char *const WORDS[] = {
+    "a", "of", "the", "and", "converter", "document", "paragraph", "layout", "measure",
+    "throughput", "pagination", "internationalization", "R&D", "naïve", "café", "Übergröße",
+    "über", "façade", "—", "résumé", "x", "table", "font", "glyph", "zip",
+};
+const int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+const int FONT_SIZES[] = {12, 10, 14, 8, 18, 11, 24, 36};
+const int MAX_FONT_SIZES = sizeof(FONT_SIZES) / sizeof(FONT_SIZES[0]);
+
+const char *const COLORS[] = {"000000", "1F3864", "C00000", "2E7D32", "7F7F7F"};
+
+void appendEscaped(std::string &out, std::string_view text)
+{
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        default: out += c; break;
+        }
+    }
+}
+
+void appendRun(std::string &xml, Random &random, int words, int fontSizes)
+{
+    xml += "<w:r><w:rPr>";
+    uint32_t style = random.next();
+    if (style % 5 == 0)
+        xml += "<w:b/>";
+    if (style % 7 == 0)
+        xml += "<w:i/>";
+    if (style % 3 == 0)
+    {
+        xml += "<w:color w:val=\"";
+        xml += COLORS[random.below(5)];
+        xml += "\"/>";
+    }
+    if (fontSizes > 1)
+    {
+        int size = FONT_SIZES[random.below(std::min(fontSizes, MAX_FONT_SIZES))];
+        xml += "<w:sz w:val=\"" + std::to_string(size * 2) + "\"/>";
+    }
+    xml += "</w:rPr><w:t xml:space=\"preserve\">";
+    for (int w = 0; w < words; ++w)
+    {
+        appendEscaped(xml, WORDS[random.below(WORD_COUNT)]);
+        xml += ' ';
+    }
+    xml += "</w:t></w:r>";
+}
+
+void appendParagraph(std::string &xml, Random &random, const CorpusSpec &spec)
+{
+    xml += "<w:p>";
+    for (int r = 0; r < spec.runsPerParagraph; ++r)
+    {
+        appendRun(xml, random, spec.wordsPerRun, spec.fontSizes);
+        if (random.below(50) == 0)
+            xml += "<w:r><w:tab/></w:r>";
+        if (random.below(80) == 0)
+            xml += "<w:r><w:br/></w:r>";
+    }
+    xml += "</w:p>";
+}
+
+void appendTable(std::string &xml, Random &random, const CorpusSpec &spec)
+{
+    xml += "<w:tbl><w:tblPr><w:tblW w:w=\"0\" w:type=\"auto\"/></w:tblPr><w:tblGrid>";
+    for (int c = 0; c < spec.tableCols; ++c)
+        xml += "<w:gridCol w:w=\"1200\"/>";
+    xml += "</w:tblGrid>";
+
+    for (int r = 0; r < spec.tableRows; ++r)
+    {
+        xml += "<w:tr>";
+        int col = 0;
+        for (int cell = 0; col < spec.tableCols; ++cell)
+        {
+            int span = 1;
+            if (spec.spanEvery > 0 && cell % spec.spanEvery == spec.spanEvery - 1 && col + 2 <= spec.tableCols)
+                span = 2;
+
+            xml += "<w:tc>";
+            if (span > 1)
+                xml += "<w:tcPr><w:gridSpan w:val=\"2\"/></w:tcPr>";
+            xml += "<w:p>";
+            int runs = 1 + random.below(3);
+            for (int i = 0; i < runs; ++i)
+                appendRun(xml, random, 1 + random.below(4), spec.fontSizes);
+            if (random.below(10) == 0)
+                xml += "<w:r><w:br/></w:r>";
+            xml += "</w:p></w:tc>";
+            col += span;
+        }
+        xml += "</w:tr>";
+    }
+    xml += "</w:tbl>";
+}
+
+void appendImage(std::string &xml, int index)
+{
+    // 4 inches wide, square
+    const long extent = 3657600;
+    std::string id = std::to_string(index + 1);
+    std::string cx = std::to_string(extent);
+
+    xml += "<w:p><w:r><w:drawing><wp:inline distT=\"0\" distB=\"0\" distL=\"0\" distR=\"0\">"
+           "<wp:extent cx=\"" + cx + "\" cy=\"" + cx + "\"/>"
+           "<wp:docPr id=\"" + id + "\" name=\"Picture " + id + "\"/>"
+           "<a:graphic xmlns:a=\"http://schemas.openxmlformats.org/drawingml/2006/main\">"
+           "<a:graphicData uri=\"http://schemas.openxmlformats.org/drawingml/2006/picture\">"
+           "<pic:pic xmlns:pic=\"http://schemas.openxmlformats.org/drawingml/2006/picture\">"
+           "<pic:nvPicPr><pic:cNvPr id=\"" + id + "\" name=\"image" + id + ".png\"/><pic:cNvPicPr/></pic:nvPicPr>"
+           "<pic:blipFill><a:blip r:embed=\"rIdImage" + id + "\"/><a:stretch><a:fillRect/></a:stretch></pic:blipFill>"
+           "<pic:spPr><a:xfrm><a:off x=\"0\" y=\"0\"/><a:ext cx=\"" + cx + "\" cy=\"" + cx + "\"/></a:xfrm>"
+           "<a:prstGeom prst=\"rect\"><a:avLst/></a:prstGeom></pic:spPr>"
+           "</pic:pic></a:graphicData></a:graphic></wp:inline></w:drawing></w:r></w:p>";
+}
+
+std::string documentXml(const CorpusSpec &spec)
+{
+    Random random(spec.seed);
+    std::string xml =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<w:document xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\" "
+        "xmlns:r=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships\" "
+        "xmlns:wp=\"http://schemas.openxmlformats.org/drawingml/2006/wordprocessingDrawing\"><w:body>";
+
+    // Tables and images are spread evenly between the paragraphs
+    int blocks = std::max(spec.paragraphs, 1);
+    int table = 0, image = 0;
+    for (int p = 0; p < spec.paragraphs; ++p)
+    {
+        appendParagraph(xml, random, spec);
+        while (table < spec.tables && static_cast<long>(table) * blocks <= static_cast<long>(p) * spec.tables)
+        {
+            appendTable(xml, random, spec);
+            table++;
+        }
+        while (image < spec.images && static_cast<long>(image) * blocks <= static_cast<long>(p) * spec.images)
+        {
+            appendImage(xml, image);
+            image++;
+        }
+    }
+    for (; table < spec.tables; ++table)
+        appendTable(xml, random, spec);
+    for (; image < spec.images; ++image)
+        appendImage(xml, image);
+
+    xml += "<w:sectPr><w:pgSz w:w=\"11906\" w:h=\"16838\"/></w:sectPr></w:body></w:document>";
+    return xml;
+}
+
+void appendU32(std::string &out, uint32_t value)
+{
+    out += static_cast<char>(value >> 24);
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+void appendChunk(std::string &png, const char *type, const std::string &data)
+{
+    appendU32(png, static_cast<uint32_t>(data.size()));
+    size_t start = png.size();
+    png.append(type, 4);
+    png += data;
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(png.data() + start), static_cast<uInt>(png.size() - start));
+    appendU32(png, static_cast<uint32_t>(crc));
+}
+
+// Noisy RGB image of roughly rawBytes, so it doesn't compress away
+std::string makePng(size_t rawBytes, Random &random)
+{
+    uint32_t side = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(rawBytes / 3.0)));
+
+    std::string raw;
+    raw.reserve(static_cast<size_t>(side) * (side * 3 + 1));
+    for (uint32_t y = 0; y < side; ++y)
+    {
+        raw += '\0'; // filter: none
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            uint32_t noise = random.next();
+            raw += static_cast<char>((x * 255 / side) ^ (noise & 0x3F));
+            raw += static_cast<char>((y * 255 / side) ^ ((noise >> 8) & 0x3F));
+            raw += static_cast<char>(noise >> 16);
+        }
+    }
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(raw.size()));
+    std::string compressed(compressedSize, '\0');
+    compress2(reinterpret_cast<Bytef *>(&compressed[0]), &compressedSize,
+              reinterpret_cast<const Bytef *>(raw.data()), static_cast<uLong>(raw.size()), Z_BEST_SPEED);
+    compressed.resize(compressedSize);
+
+    std::string header;
+    appendU32(header, side);
+    appendU32(header, side);
+    header += '\x08'; // bit depth
+    header += '\x02'; // truecolor
+    header += '\0';   // compression
+    header += '\0';   // filter
+    header += '\0';   // interlace
+
+    std::string png("\x89PNG\r\n\x1a\n", 8);
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", compressed);
+    appendChunk(png, "IEND", std::string());
+    return png;
+}
+
+bool addPart(zip_t *archive, const std::string &name, const std::string &data, bool store)
+{
+    zip_source_t *source = zip_source_buffer(archive, data.data(), data.size(), 0);
+    if (!source)
+        return false;
+
+    zip_int64_t index = zip_file_add(archive, name.c_str(), source, ZIP_FL_OVERWRITE);
+    if (index < 0)
+    {
+        zip_source_free(source);
+        return false;
+    }
+    if (store)
+        zip_set_file_compression(archive, index, ZIP_CM_STORE, 0);
+    return true;
+}
+} // namespace
+
+bool generateDocx(const CorpusSpec &spec, const std::string &path)
+{
+    // libzip reads the buffers when the archive is closed, so all parts are
+    // kept alive until then
+    std::vector<std::string> parts;
+    parts.reserve(4 + spec.images);
+
+    std::string contentTypes =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+        "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+        "<Default Extension=\"png\" ContentType=\"image/png\"/>"
+        "<Override PartName=\"/word/document.xml\" "
+        "ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>"
+        "</Types>";
+
+    std::string packageRels =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Id=\"rId1\" "
+        "Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" "
+        "Target=\"word/document.xml\"/></Relationships>";
+
+    std::string documentRels =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">";
+    for (int i = 0; i < spec.images; ++i)
+    {
+        std::string id = std::to_string(i + 1);
+        documentRels += "<Relationship Id=\"rIdImage" + id + "\" "
+                        "Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/image\" "
+                        "Target=\"media/image" + id + ".png\"/>";
+    }
+    documentRels += "</Relationships>";
+
+    int error = 0;
+    zip_t *archive = zip_open(path.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error);
+    if (!archive)
+    {
+        std::cerr << "Failed to create " << path << " (libzip error " << error << ")" << std::endl;
+        return false;
+    }
+
+    parts.push_back(std::move(contentTypes));
+    bool ok = addPart(archive, "[Content_Types].xml", parts.back(), false);
+    parts.push_back(std::move(packageRels));
+    ok = ok && addPart(archive, "_rels/.rels", parts.back(), false);
+    parts.push_back(documentXml(spec));
+    ok = ok && addPart(archive, "word/document.xml", parts.back(), false);
+    parts.push_back(std::move(documentRels));
+    ok = ok && addPart(archive, "word/_rels/document.xml.rels", parts.back(), false);
+
+    // Media is already compressed, store it like Word does
+    Random random(spec.seed * 2654435761u);
+    for (int i = 0; ok && i < spec.images; ++i)
+    {
+        parts.push_back(makePng(spec.imageBytes, random));
+        ok = addPart(archive, "word/media/image" + std::to_string(i + 1) + ".png", parts.back(), true);
+    }
+
+    if (!ok)
+    {
+        std::cerr << "Failed to add parts to " << path << ": " << zip_strerror(archive) << std::endl;
+        zip_discard(archive);
+        return false;
+    }
+
+    if (zip_close(archive) != 0)
+    {
+        std::cerr << "Failed to write " << path << ": " << zip_strerror(archive) << std::endl;
+        zip_discard(archive);
+        return false;
+    }
+    return true;
+}
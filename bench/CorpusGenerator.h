@@ -0,0 +1,38 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of one synthetic document. Every axis the converter's cost depends on
+// can be scaled on its own; the same spec always produces the same file.
+struct CorpusSpec
+{
+    std::string name;
+
+    int paragraphs = 100;
+    int runsPerParagraph = 4;
+    int wordsPerRun = 10;
+
+    int tables = 0;
+    int tableRows = 0;
+    int tableCols = 0;
+    int spanEvery = 0; // every Nth cell of a row spans two columns, 0 for none
+
+    int fontSizes = 1; // distinct font sizes mixed into the runs, 1 keeps everything at 12pt
+
+    int images = 0;
+    size_t imageBytes = 0; // uncompressed RGB size of each PNG
+
+    uint32_t seed = 1;
+};
+
+// The documents the bench target runs by default
+std::vector<CorpusSpec> defaultCorpus();
+
+// Writes the spec as a .docx to path
+bool generateDocx(const CorpusSpec &spec, const std::string &path);
+
+#endif
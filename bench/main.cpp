@@ -0,0 +1,242 @@
+#include "CorpusGenerator.h"
+#include "DocxParser.h"
+#include "DocxToPdfConverter.h"
+#include "Metrics.h"
+#include "PdfEmitter.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#ifndef DOCX2PDF_VERSION
+#define DOCX2PDF_VERSION "unknown"
+#endif
+
+namespace fs = boost::filesystem;
+
+struct Result
+{
+    CorpusSpec spec;
+    uintmax_t docxBytes = 0;
+    size_t documentXmlBytes = 0;
+    size_t pages = 0;
+    uintmax_t pdfBytes = 0;
+    double medianStage[STAGE_COUNT] = {};
+    double medianTotal = 0;
+    double bestTotal = 0;
+    ConversionMetrics last; // counters of the last run
+    bool ok = false;
+};
+
+// One conversion with metrics on, the same path convertDocx takes
+static bool convertOnce(const std::string &docxPath, const std::string &pdfPath, ConversionMetrics &metrics,
+                        size_t &pages, size_t &documentXmlBytes)
+{
+    MetricsScope scope(&metrics);
+
+    DocxArchive archive;
+    const std::string *documentXml = archive.open(docxPath) ? archive.part("word/document.xml") : nullptr;
+    if (!documentXml)
+    {
+        return false;
+    }
+    documentXmlBytes = documentXml->size();
+
+    Layout layout;
+    if (!layoutArchive(archive, layout))
+    {
+        return false;
+    }
+    pages = layout.pages.size();
+
+    return writePdf(layout, pdfPath, archiveImages(archive));
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static Result runDocument(const CorpusSpec &spec, const fs::path &corpusDir, int iterations)
+{
+    Result result;
+    result.spec = spec;
+
+    std::string docxPath = (corpusDir / (spec.name + ".docx")).string();
+    std::string pdfPath = (corpusDir / (spec.name + ".pdf")).string();
+    if (!generateDocx(spec, docxPath))
+    {
+        return result;
+    }
+    result.docxBytes = fs::file_size(docxPath);
+
+    std::vector<double> stages[STAGE_COUNT], total;
+    for (int i = 0; i < iterations; ++i)
+    {
+        ConversionMetrics metrics;
+        if (!convertOnce(docxPath, pdfPath, metrics, result.pages, result.documentXmlBytes))
+        {
+            std::cerr << "Conversion of " << docxPath << " failed" << std::endl;
+            return result;
+        }
+        for (int stage = 0; stage < STAGE_COUNT; ++stage)
+        {
+            stages[stage].push_back(metrics.stageNanos[stage] / 1e6);
+        }
+        total.push_back(metrics.totalNanos / 1e6);
+        result.last = metrics;
+    }
+
+    for (int stage = 0; stage < STAGE_COUNT; ++stage)
+    {
+        result.medianStage[stage] = median(stages[stage]);
+    }
+    result.medianTotal = median(total);
+    result.bestTotal = *std::min_element(total.begin(), total.end());
+    result.pdfBytes = fs::file_size(pdfPath);
+    result.ok = true;
+    return result;
+}
+
+static double pagesPerSecond(const Result &result)
+{
+    return result.medianTotal > 0 ? result.pages * 1000.0 / result.medianTotal : 0;
+}
+
+static double megabytesPerSecond(const Result &result)
+{
+    return result.medianTotal > 0 ? (result.docxBytes / 1048576.0) * 1000.0 / result.medianTotal : 0;
+}
+
+static void writeJson(std::ostream &out, const std::vector<Result> &results, int iterations)
+{
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"version\": \"" << DOCX2PDF_VERSION << "\",\n  \"iterations\": " << iterations
+        << ",\n  \"documents\": [";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result &r = results[i];
+        const CorpusSpec &s = r.spec;
+        out << (i ? ",\n" : "\n") << "    {\n"
+            << "      \"name\": \"" << s.name << "\",\n"
+            << "      \"ok\": " << (r.ok ? "true" : "false") << ",\n"
+            << "      \"params\": {\"paragraphs\": " << s.paragraphs << ", \"runs_per_paragraph\": " << s.runsPerParagraph
+            << ", \"words_per_run\": " << s.wordsPerRun << ", \"tables\": " << s.tables
+            << ", \"table_rows\": " << s.tableRows << ", \"table_cols\": " << s.tableCols
+            << ", \"span_every\": " << s.spanEvery << ", \"font_sizes\": " << s.fontSizes
+            << ", \"images\": " << s.images << ", \"image_bytes\": " << s.imageBytes << ", \"seed\": " << s.seed
+            << "},\n"
+            << "      \"docx_bytes\": " << r.docxBytes << ",\n"
+            << "      \"document_xml_bytes\": " << r.documentXmlBytes << ",\n"
+            << "      \"pdf_bytes\": " << r.pdfBytes << ",\n"
+            << "      \"pages\": " << r.pages << ",\n"
+            << "      \"median_ms\": {";
+        for (int stage = 0; stage < STAGE_COUNT; ++stage)
+        {
+            out << "\"" << metricStageName(static_cast<MetricStage>(stage)) << "\": " << r.medianStage[stage] << ", ";
+        }
+        out << "\"total\": " << r.medianTotal << "},\n"
+            << "      \"best_total_ms\": " << r.bestTotal << ",\n"
+            << "      \"last_run\": ";
+        r.last.writeJson(out);
+        out << ",\n"
+            << "      \"pages_per_sec\": " << pagesPerSecond(r) << ",\n"
+            << "      \"mb_per_sec\": " << megabytesPerSecond(r) << "\n"
+            << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [--out <corpus_dir>] [--iterations N] [--filter <name>] [--json <file>]\n"
+              << "Generates the synthetic corpus, converts each document N times (default 3) and\n"
+              << "reports the median time of every stage. Results are written as JSON\n"
+              << "(default bench_results.json) so runs can be diffed between releases.\n";
+}
+
+int main(int argc, char *argv[])
+{
+    fs::path corpusDir = "bench-corpus";
+    std::string jsonPath = "bench_results.json";
+    std::string filter;
+    int iterations = 3;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc)
+        {
+            corpusDir = argv[++i];
+        }
+        else if (arg == "--iterations" && i + 1 < argc)
+        {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (arg == "--json" && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    boost::system::error_code ec;
+    fs::create_directories(corpusDir, ec);
+    if (ec)
+    {
+        std::cerr << "Failed to create " << corpusDir.string() << ": " << ec.message() << std::endl;
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(20) << "document" << std::right << std::setw(7) << "pages"
+              << std::setw(10) << "unzip" << std::setw(10) << "parse" << std::setw(10) << "layout"
+              << std::setw(10) << "emit" << std::setw(10) << "save" << std::setw(10) << "total"
+              << std::setw(10) << "pages/s" << std::setw(9) << "MB/s" << std::endl;
+
+    std::vector<Result> results;
+    bool failed = false;
+    for (const CorpusSpec &spec : defaultCorpus())
+    {
+        if (!filter.empty() && spec.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        Result result = runDocument(spec, corpusDir, iterations);
+        failed = failed || !result.ok;
+        results.push_back(result);
+
+        std::cout << std::left << std::setw(20) << spec.name << std::right << std::setw(7) << result.pages
+                  << std::fixed << std::setprecision(2) << std::setw(10) << result.medianStage[STAGE_UNZIP]
+                  << std::setw(10) << result.medianStage[STAGE_XML_PARSE] << std::setw(10)
+                  << result.medianStage[STAGE_LAYOUT] << std::setw(10) << result.medianStage[STAGE_EMIT]
+                  << std::setw(10) << result.medianStage[STAGE_SAVE] << std::setw(10) << result.medianTotal
+                  << std::setprecision(1) << std::setw(10) << pagesPerSecond(result)
+                  << std::setprecision(2) << std::setw(9) << megabytesPerSecond(result) << std::endl;
+    }
+
+    std::ofstream json(jsonPath);
+    if (!json.is_open())
+    {
+        std::cerr << "Failed to write " << jsonPath << std::endl;
+        return 1;
+    }
+    writeJson(json, results, iterations);
+    std::cout << "Times are median milliseconds over " << iterations << " runs, results written to " << jsonPath
+              << std::endl;
+
+    return failed ? 1 : 0;
+}
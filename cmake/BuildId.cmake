@@ -0,0 +1,23 @@
+# Writes BuildId.h with a hash of the converter sources. Run at build time by
+# CMakeLists.txt, so an edited source changes the id without a reconfigure.
+# The file is only rewritten when the id changes.
+file(GLOB_RECURSE inputs ${SOURCE_DIR}/src/*.cpp ${SOURCE_DIR}/include/*.h)
+list(SORT inputs)
+
+set(hashes "")
+foreach(input ${inputs})
+    file(SHA256 ${input} hash)
+    file(RELATIVE_PATH name ${SOURCE_DIR} ${input})
+    string(APPEND hashes "${name} ${hash}\n")
+endforeach()
+string(SHA256 id "${hashes}")
+string(SUBSTRING ${id} 0 16 id)
+
+set(content "#define DOCX2PDF_BUILD_ID \"${id}\"\n")
+set(previous "")
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+endif()
+if(NOT previous STREQUAL content)
+    file(WRITE ${OUTPUT} "${content}")
+endif()
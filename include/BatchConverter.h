@@ -0,0 +1,31 @@
+#ifndef BATCHCONVERTER_H
+#define BATCHCONVERTER_H
+
+#include <string>
+#include <vector>
+
+class ResultCache;
+
+struct BatchJob
+{
+    std::string inputPath;
+    std::string outputPath;
+};
+
+// Expands source into jobs writing to outputDir. source can be
+//   - a directory, searched recursively for .docx files (subdirectories are mirrored)
+//   - a glob pattern such as "in/*.docx"
+//   - "@manifest.txt", one input per line, optionally followed by a tab and an output path
+//   - a single .docx file
+bool collect_batch_jobs(const std::string &source, const std::string &outputDir,
+                        std::vector<BatchJob> &jobs);
+
+// Converts all jobs on threadCount workers (0 = one per core) and prints
+// per-file and aggregate throughput. Returns the number of failed files.
+// With a metricsPath ("-" for stderr) per-stage metrics of every conversion
+// are written as JSON lines, followed by one line with the aggregate histograms.
+// With a cache, unchanged inputs are served from it and its counters are printed.
+size_t run_batch(const std::vector<BatchJob> &jobs, size_t threadCount, const std::string &metricsPath = "",
+                 ResultCache *cache = nullptr);
+
+#endif
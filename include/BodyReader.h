@@ -0,0 +1,42 @@
+#ifndef BODYREADER_H
+#define BODYREADER_H
+
+#include <string_view>
+
+// Pull parser over document.xml that hands out the children of <w:body>
+// (w:p, w:tbl, w:sectPr...) one at a time as slices of the original buffer.
+// Only tag boundaries are scanned here, so each slice can be parsed into a
+// small DOM on its own instead of building a DOM for the whole document.
+class BodyReader
+{
+public:
+    explicit BodyReader(std::string_view xml) : xml_(xml) {}
+
+    // Positions the reader just after the <w:body> start tag
+    bool open();
+
+    // Returns the next body-level element, false once </w:body> is reached
+    bool next(std::string_view &element);
+
+    // True if the XML ended in the middle of markup or an element
+    bool failed() const { return failed_; }
+
+private:
+    enum TagKind
+    {
+        TAG_START,
+        TAG_END,
+        TAG_EMPTY, // self-closing <x/>
+        TAG_OTHER  // comment, CDATA, processing instruction, DOCTYPE
+    };
+
+    // Scans the markup at pos (which must point at '<'), sets pos past it
+    bool scanTag(size_t &pos, TagKind &kind, std::string_view &name);
+
+    std::string_view xml_;
+    size_t pos_ = 0;
+    bool inBody_ = false;
+    bool failed_ = false;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef CONVERSIONSERVER_H
+#define CONVERSIONSERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <set>
+#include <string>
+#include "Converter.h"
+
+// Wire protocol on the Unix socket. Every message is a 1-byte type or status
+// followed by a 4-byte big-endian payload length and the payload. A connection
+// can carry any number of requests, each answered before the next is read.
+//
+// Requests:
+//   'D'  payload is the DOCX file itself, the reply carries the PDF bytes
+//   'F'  payload is "<input path>\0<output path>"; the server reads the input
+//        itself. With an output path the PDF is written there and the reply
+//        carries the path, with an empty one the reply carries the PDF bytes.
+//
+// Replies:
+//   '0'  success, payload as above
+//   '1'  failure, payload is an error message
+namespace protocol
+{
+const char REQUEST_DOCX = 'D';
+const char REQUEST_FILE = 'F';
+const char REPLY_OK = '0';
+const char REPLY_ERROR = '1';
+const uint32_t MAX_PAYLOAD = 512u * 1024 * 1024;
+} // namespace protocol
+
+struct ServerOptions
+{
+    std::string socketPath;
+    size_t threads = 0;   // conversion workers, 0 = one per core
+    size_t maxQueued = 0; // accepted connections waiting for a worker, 0 = two per worker
+    std::string cacheDir; // result cache, none when empty
+    uint64_t cacheBytes = 0;
+};
+
+// Long-running conversion service. Fonts are loaded once at startup and every
+// request reuses them, so a small document costs milliseconds instead of a
+// process start. At most threads + maxQueued connections are accepted at a
+// time; beyond that the acceptor stops and clients wait in the listen backlog.
+class ConversionServer
+{
+public:
+    explicit ConversionServer(const ServerOptions &options);
+    ~ConversionServer();
+
+    ConversionServer(const ConversionServer &) = delete;
+    ConversionServer &operator=(const ConversionServer &) = delete;
+
+    // Serves until stop() is called or the process gets SIGINT/SIGTERM.
+    // Returns false if the fonts or the socket could not be set up.
+    bool run();
+
+    // Stops accepting; connections finish the request they are on
+    void stop();
+
+private:
+    void serveConnection(int fd);
+    bool handleRequest(int fd, char type, const std::string &payload, std::string &summary);
+    bool convertBytes(const std::string &docx, std::string &pdf, std::string &error,
+                      std::ostringstream &description);
+    void releaseSlot(int fd);
+
+    ServerOptions options_;
+    Converter converter_; // holds the result cache
+    int listenFd_ = -1;
+    std::atomic<bool> stopping_{false};
+
+    std::mutex mutex_;
+    std::condition_variable slotFreed_;
+    std::set<int> connections_; // accepted and not yet closed
+    std::mutex logMutex_;
+};
+
+// Client side: sends input to the server at socketPath and writes the PDF to
+// output. inlineBytes sends the DOCX itself, otherwise the server opens the
+// path and writes the output path directly.
+bool request_conversion(const std::string &socketPath, const std::string &input, const std::string &output,
+                        bool inlineBytes);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CONVERTER_H
+#define CONVERTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "Diagnostics.h"
+#include "Metrics.h"
+
+class ResultCache;
+
+struct ConverterOptions
+{
+    std::string cacheDir; // result cache, none when empty
+    uint64_t cacheBytes = 0;
+    bool metrics = false; // fill ConvertResult::metrics
+};
+
+struct ConvertResult
+{
+    std::string pdf; // empty unless the conversion succeeded
+    bool cached = false;
+    Diagnostics diagnostics;
+    ConversionMetrics metrics;
+
+    bool ok() const { return diagnostics.error == CONVERT_OK; }
+};
+
+// Entry point for programs linking libdocx2pdf. One converter is meant to be
+// shared: convert() may run on any number of threads at once, the fonts and
+// the result cache are shared between them and nothing is written to disk
+// (but by convertFile) or to stdout/stderr on the way. The layout cache is process-wide, see
+// LayoutCache::enable.
+class Converter
+{
+public:
+    explicit Converter(const ConverterOptions &options = ConverterOptions());
+    ~Converter();
+
+    Converter(const Converter &) = delete;
+    Converter &operator=(const Converter &) = delete;
+
+    // Loads the fonts and opens the result cache. Call once before sharing
+    // the converter; until it succeeds conversions run without the cache.
+    bool open(Diagnostics &diagnostics);
+
+    // Converts a DOCX held in memory. The bytes are only read during the call.
+    ConvertResult convert(std::string_view docx) const;
+    ConvertResult convert(const void *data, size_t size) const;
+
+    // Converts the DOCX at docxPath and writes the PDF to pdfPath, pdf is
+    // left empty. Failing to read or write either file is a CONVERT_IO_ERROR.
+    ConvertResult convertFile(const std::string &docxPath, const std::string &pdfPath) const;
+
+    // nullptr without a cache directory or before open()
+    ResultCache *cache() const { return cache_.get(); }
+
+private:
+    void run(std::string_view docx, ConvertResult &result) const;
+
+    ConverterOptions options_;
+    std::unique_ptr<ResultCache> cache_;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <string>
+#include <vector>
+
+// Why a conversion failed. The first error reported decides, later ones are
+// usually its consequences.
+enum ConvertError
+{
+    CONVERT_OK,
+    CONVERT_INVALID_ARCHIVE,   // not a ZIP file, or a part that can't be decompressed
+    CONVERT_MISSING_DOCUMENT,  // no word/document.xml, or no body in it
+    CONVERT_FONTS_UNAVAILABLE, // the DejaVu fonts couldn't be loaded
+    CONVERT_PDF_FAILED,        // libharu couldn't build or serialize the document
+    CONVERT_IO_ERROR,          // reading an input or writing an output file
+    CONVERT_ERROR_COUNT
+};
+
+// "ok", "invalid_archive", ... for logs and error replies
+const char *convertErrorName(ConvertError error);
+
+// What went wrong in one conversion. Warnings name what a successful
+// conversion left out, a damaged image or an unreadable styles.xml.
+struct Diagnostics
+{
+    ConvertError error = CONVERT_OK;
+    std::string message; // of the first error
+    std::vector<std::string> warnings;
+};
+
+// Diagnostics of the conversion running on this thread, nullptr when the
+// caller didn't ask for them
+Diagnostics *currentDiagnostics();
+
+// Makes diagnostics the current conversion's diagnostics on this thread for
+// the lifetime of the scope. parallelFor hands them on to its helpers.
+class DiagnosticsScope
+{
+public:
+    explicit DiagnosticsScope(Diagnostics *diagnostics);
+    ~DiagnosticsScope();
+    DiagnosticsScope(const DiagnosticsScope &) = delete;
+    DiagnosticsScope &operator=(const DiagnosticsScope &) = delete;
+
+private:
+    Diagnostics *previous_;
+};
+
+// Recorded in the current diagnostics, or written to std::cerr without any,
+// which is what the command line tools rely on
+void reportError(ConvertError error, const std::string &message);
+void reportWarning(const std::string &message);
+
+#endif
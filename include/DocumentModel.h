@@ -0,0 +1,130 @@
+#ifndef DOCUMENTMODEL_H
+#define DOCUMENTMODEL_H
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "FontMetrics.h"
+#include "Images.h"
+#include "StyleTable.h"
+
+namespace tinyxml2
+{
+class XMLElement;
+}
+
+// Resolved formatting of a run, packed into 8 bytes so fragments stay small
+// and two formats compare in a few instructions
+struct RunFormat
+{
+    uint32_t rgb = 0;         // 0xRRGGBB
+    uint16_t halfPoints = 24; // as in w:sz
+    uint8_t fontId = FONT_REGULAR;
+
+    int fontSize() const { return halfPoints / 2; }
+    FontId font() const { return static_cast<FontId>(fontId); }
+    float red() const { return ((rgb >> 16) & 0xFF) / 255.0f; }
+    float green() const { return ((rgb >> 8) & 0xFF) / 255.0f; }
+    float blue() const { return (rgb & 0xFF) / 255.0f; }
+};
+
+// A piece of text with uniform formatting. The text is not copied, it points
+// into the parsed element and is valid for as long as its XMLDocument is.
+struct TextFragment
+{
+    std::string_view text;
+    RunFormat format;
+};
+
+// Run formats of one document. A run is read in one pass over its <w:rPr>;
+// runs that set the same properties with the same paragraph and character
+// style share a format, which is resolved against the styles once and looked
+// up by those few fields afterwards. The table lives in the conversion's arena.
+class RunFormatTable
+{
+public:
+    RunFormatTable(const StyleTable &styles, std::pmr::memory_resource *arena) : styles_(styles), formats_(arena) {}
+
+    const StyleTable &styles() const { return styles_; }
+
+    // Format of a run with properties rPr (may be null) in a paragraph of paragraphStyle
+    RunFormat resolve(const tinyxml2::XMLElement *rPr, uint16_t paragraphStyle);
+
+    // Distinct formats resolved so far
+    size_t size() const { return formats_.size(); }
+
+private:
+    // Everything a run's format depends on, 16 bytes
+    struct FormatKey
+    {
+        uint16_t paragraphStyle;
+        uint16_t characterStyle;
+        RunProps direct; // the run's own <w:rPr>
+
+        bool operator==(const FormatKey &other) const;
+    };
+
+    struct FormatKeyHash
+    {
+        size_t operator()(const FormatKey &key) const;
+    };
+
+    RunFormat decode(const FormatKey &key) const;
+
+    const StyleTable &styles_;
+    std::pmr::unordered_map<FormatKey, RunFormat, FormatKeyHash> formats_;
+};
+
+// Model containers allocate from the arena they are constructed with, so a
+// whole document's model is released at once when the arena goes away
+struct TableCell
+{
+    explicit TableCell(std::pmr::memory_resource *arena) : textFragments(arena) {}
+
+    std::pmr::vector<TextFragment> textFragments;
+    size_t gridSpan = 1; // Default gridSpan is 1 (no colspan)
+};
+
+struct Table
+{
+    explicit Table(std::pmr::memory_resource *arena) : rows(arena) {}
+
+    std::pmr::vector<std::pmr::vector<TableCell>> rows; // Each row contains multiple cells
+};
+
+// Content of a paragraph's runs in document order
+struct ParagraphItem
+{
+    enum Kind
+    {
+        TEXT,
+        TAB,
+        BREAK,
+        IMAGE // an inline picture, drawn with its bottom on the baseline
+    };
+
+    Kind kind = TEXT;
+    TextFragment fragment; // the format is also set for TAB, BREAK and IMAGE
+    int imageId = -1;      // IMAGE: ID in the document's ImageTable
+    float imageWidth = 0.0f, imageHeight = 0.0f; // IMAGE: extent in points
+};
+
+struct Paragraph
+{
+    explicit Paragraph(std::pmr::memory_resource *arena) : items(arena) {}
+
+    std::pmr::vector<ParagraphItem> items;
+    int endFontSize = 12; // Size in effect after the last run, sets the spacing after the paragraph
+};
+
+// Builds the model for a <w:p> / <w:tbl> element in arena. Run formatting is
+// resolved through formats; list markers are numbered by counters, pictures
+// are looked up in images. All are shared by all elements of a document,
+// null counters leave markers out and null images leave pictures out.
+Paragraph parseParagraph(tinyxml2::XMLElement *pElement, std::pmr::memory_resource *arena, RunFormatTable &formats,
+                         ListCounters *counters, ImageTable *images = nullptr);
+Table parseTable(tinyxml2::XMLElement *tblElement, std::pmr::memory_resource *arena, RunFormatTable &formats);
+
+#endif
@@ -1,9 +1,100 @@
 #ifndef DOCXPARSER_H
 #define DOCXPARSER_H
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct zip;
+
+// Read-only view of a DOCX archive. The part index is built from the ZIP
+// central directory when the archive is opened, but a part's data is only
+// decompressed the first time it is requested and then kept in memory, or
+// ahead of time on other cores when it is prefetched.
+class DocxArchive
+{
+public:
+    DocxArchive() = default;
+    ~DocxArchive();
+
+    DocxArchive(const DocxArchive &) = delete;
+    DocxArchive &operator=(const DocxArchive &) = delete;
+
+    bool open(const std::string &docx_path);
+
+    // Opens a DOCX held in memory, e.g. received over a socket. The bytes are
+    // not copied and must stay valid until the archive is closed.
+    bool openFromBuffer(std::string_view data);
+
+    void close();
+
+    bool hasPart(const std::string &name) const;
+
+    // Uncompressed size from the central directory, 0 if the part doesn't exist
+    size_t partSize(const std::string &name) const;
+
+    // Names of all parts starting with prefix, e.g. "word/media/"
+    std::vector<std::string> partNames(const std::string &prefix) const;
+
+    // Decompresses the part on first use, returns nullptr if missing or unreadable
+    const std::string *part(const std::string &name);
+
+    // Decompresses the part into data without keeping it, for media that is
+    // read once. Returns false if missing or unreadable.
+    bool readPart(const std::string &name, std::string &data);
+
+    // Starts decompressing the named parts on the helper threads and returns
+    // at once. Every helper opens its own handle on the file or buffer and
+    // takes the parts in the order given. part() and readPart() then wait for
+    // a prefetched part instead of decompressing it again. Missing parts and
+    // parts already read are skipped; without helper threads nothing happens.
+    // At most windowBytes of prefetched parts are held that haven't been read
+    // yet, the rest follow in order as earlier ones are read. A later call
+    // replaces the parts still waiting for room.
+    void prefetch(const std::vector<std::string> &names, uint64_t windowBytes = UINT64_MAX);
+
+private:
+    bool indexEntries();
+
+    struct Prefetch;      // a part being decompressed by a helper thread
+    struct PrefetchBatch; // the parts of one prefetch() call
+
+    struct Entry
+    {
+        unsigned long long index = 0;
+        unsigned long long size = 0;
+        std::unique_ptr<std::string> data; // null until first requested
+        std::shared_ptr<Prefetch> prefetch; // set while a helper owns the part
+        unsigned window = 0;                // prefetch() call the part was prefetched for
+    };
+
+    // Hands the waiting parts that fit the window to the helpers
+    void issuePrefetches();
+
+    static void runPrefetch(PrefetchBatch &batch);
+
+    // Moves a prefetched part into data once it is done, false if the helper failed
+    bool takePrefetched(Entry &entry, std::string &data);
+
+    zip *archive_ = nullptr;
+    std::string path_;
+    std::string_view buffer_; // the archive's bytes when opened from memory
+    std::unordered_map<std::string, Entry> entries_;
+    std::vector<std::shared_ptr<PrefetchBatch>> batches_;
+    std::vector<std::string> waiting_; // prefetched parts not handed out yet
+    size_t nextWaiting_ = 0;
+    uint64_t windowBytes_ = UINT64_MAX;
+    uint64_t unreadBytes_ = 0; // prefetched for the latest call and not read yet
+    unsigned window_ = 0;      // counts prefetch() calls
+};
 
 bool create_directories(const std::string &dir);
+
+// Extracts every entry of the DOCX under output_dir, on several cores with a
+// handle on the archive per chunk of entries
 bool unzip_docx(const std::string &docx_path, const std::string &output_dir);
 
 #endif
@@ -2,8 +2,43 @@
 #define DOCXTOPDFCONVERTER_H
 
 #include <string>
+#include <string_view>
+#include "DocxParser.h"
+#include "Layout.h"
+#include "PdfEmitter.h"
+
+class ImageTable;
+class ResultCache;
+class StyleTable;
 
 // pass in by const reference to save memory space
-void generatePDF(const std::string &docxDir, const std::string &outputPdfPath);
+bool generatePDF(const std::string &docxDir, const std::string &outputPdfPath);
+
+// same as above but reads the parts from memory instead of an extracted directory
+bool generatePDF(DocxArchive &archive, const std::string &outputPdfPath);
+
+// Converts an opened archive and returns the PDF in pdfBytes, nothing touches the disk
+bool generatePDFToMemory(DocxArchive &archive, std::string &pdfBytes);
+
+// Converts an opened archive and writes the PDF to fd, e.g. stdout or a pipe
+bool generatePDFToFd(DocxArchive &archive, int fd);
+
+// Parses and lays out document.xml without producing any PDF output. Without
+// styles every paragraph uses the built-in defaults, without images pictures
+// are left out. The parts of the pictures drawn end up in layout.imageParts.
+bool layoutDocument(std::string_view documentXml, Layout &layout, const StyleTable *styles = nullptr,
+                    ImageTable *images = nullptr);
+
+// Lays out an opened archive's document.xml with its styles, numbering and pictures
+bool layoutArchive(DocxArchive &archive, Layout &layout);
+
+// Reads the pictures of a layout from the archive it was made from, for the writePdf functions
+ImageSource archiveImages(DocxArchive &archive);
+
+// Opens docxPath and converts it, the single-file path used by the CLI and batch workers.
+// With a cache, a DOCX converted before is answered from it and new results are stored;
+// cached tells which it was.
+bool convertDocx(const std::string &docxPath, const std::string &outputPdfPath, ResultCache *cache = nullptr,
+                 bool *cached = nullptr);
 
 #endif
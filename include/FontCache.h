@@ -0,0 +1,43 @@
+#ifndef FONTCACHE_H
+#define FONTCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "FontMetrics.h"
+#include "MappedFile.h"
+
+// Directory holding the DejaVu TTFs. Resolved once: $DOCX2PDF_FONT_DIR if set,
+// then ../fonts and ./fonts relative to the working directory, then the
+// source tree the binary was built from.
+const std::string &fontDirectory();
+
+std::string fontFilePath(FontId id);
+
+// Font data shared by every conversion in the process. Each TTF is mapped
+// into memory once and its metrics parsed once; after loading nothing is ever
+// modified, so any number of threads can read it without locking.
+class FontCache
+{
+public:
+    // Loads on first use, returns nullptr if a font could not be loaded
+    static const FontCache *instance();
+
+    const FontMetrics &metrics(FontId id) const { return metrics_[id]; }
+
+    // The mapped TTF file
+    std::string_view fontData(FontId id) const { return files_[id].view(); }
+
+    // Hash of all four files, changes when any font is replaced
+    uint64_t fingerprint() const { return fingerprint_; }
+
+private:
+    FontCache() = default;
+    bool load();
+
+    MappedFile files_[FONT_COUNT];
+    FontMetrics metrics_[FONT_COUNT];
+    uint64_t fingerprint_ = 0;
+};
+
+#endif
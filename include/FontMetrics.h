@@ -0,0 +1,128 @@
+#ifndef FONTMETRICS_H
+#define FONTMETRICS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The four DejaVu faces the converter renders with
+enum FontId
+{
+    FONT_REGULAR,
+    FONT_BOLD,
+    FONT_ITALIC,
+    FONT_BOLD_ITALIC,
+    FONT_COUNT
+};
+
+// Decodes one UTF-8 sequence at text[pos], advancing pos. Malformed bytes
+// decode to U+FFFD one byte at a time.
+uint32_t decodeUtf8(std::string_view text, size_t &pos);
+
+
+// Horizontal metrics of a TrueType font, read once from its cmap and hmtx
+// tables. Widths are in 1/1000 em, truncated per glyph exactly like libharu
+// does, so sums match HPDF_Page_TextWidth.
+class FontMetrics
+{
+public:
+    FontMetrics() = default;
+    FontMetrics(const FontMetrics &) = delete;
+    FontMetrics &operator=(const FontMetrics &) = delete;
+
+    bool loadFromFile(const std::string &path);
+
+    // Parses font data owned by the caller, which must outlive this object
+    bool load(std::string_view data);
+
+    // The raw TTF bytes the metrics were read from
+    std::string_view data() const { return data_; }
+
+    uint16_t glyphIndex(uint32_t codepoint) const;
+    int glyphWidth(uint16_t glyph) const;
+
+    int charWidth(uint32_t codepoint) const
+    {
+        return codepoint < bmpWidths_.size() ? bmpWidths_[codepoint] : glyphWidth(glyphIndex(codepoint));
+    }
+
+    size_t glyphCount() const { return glyphWidths_.size(); }
+
+private:
+    bool parse();
+    bool parseCmap(const unsigned char *table, size_t length);
+
+    struct CmapGroup
+    {
+        uint32_t firstChar;
+        uint32_t lastChar;
+        uint32_t firstGlyph;
+    };
+
+    std::string_view data_;
+    std::string owned_; // backing store when loaded from a file
+    std::vector<uint16_t> glyphWidths_; // indexed by glyph id
+    std::vector<uint16_t> bmpGlyphs_;   // glyph id for each BMP codepoint
+    std::vector<uint16_t> bmpWidths_;   // width for each BMP codepoint, the hot path
+    std::vector<CmapGroup> groups_;     // codepoints above the BMP (cmap format 12)
+};
+
+// Measures UTF-8 text for a set of fonts without touching libharu. Per-codepoint
+// widths come from FontMetrics, and whole words are memoized per font so that
+// repeated words (and the second pass over table text) cost one hash lookup.
+class TextMeasurer
+{
+public:
+    void setFont(FontId id, const FontMetrics *metrics) { fonts_[id] = metrics; }
+
+    // Width in points, same as HPDF_Page_TextWidth with that font and size set
+    float textWidth(FontId font, float fontSize, std::string_view text)
+    {
+        return measureUnits(font, text) * fontSize / 1000.0f;
+    }
+
+    // A measurer over the same fonts with an empty memo, for measuring on another thread
+    TextMeasurer sharingFonts() const
+    {
+        TextMeasurer measurer;
+        for (int id = 0; id < FONT_COUNT; ++id)
+            measurer.fonts_[id] = fonts_[id];
+        return measurer;
+    }
+
+    // Calls to textWidth so far, for the metrics
+    uint64_t tokensMeasured() const { return tokensMeasured_; }
+
+private:
+    int measureUnits(FontId font, std::string_view text);
+
+    // Open-addressing table of word -> width, words are copied into one pool
+    class WordWidthMemo
+    {
+    public:
+        bool find(std::string_view word, uint64_t hash, int &units) const;
+        void insert(std::string_view word, uint64_t hash, int units);
+
+    private:
+        struct Slot
+        {
+            uint64_t hash = 0;
+            uint32_t offset = 0;
+            uint32_t length = 0;
+            int units = -1; // -1 marks an empty slot
+        };
+
+        void grow();
+
+        std::vector<Slot> slots_;
+        std::string pool_;
+        size_t used_ = 0;
+    };
+
+    const FontMetrics *fonts_[FONT_COUNT] = {};
+    WordWidthMemo memo_[FONT_COUNT];
+    uint64_t tokensMeasured_ = 0;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef FONTSUBSETTER_H
+#define FONTSUBSETTER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Builds a copy of a TrueType font whose glyf table holds only the outlines
+// in usedGlyphs (indexed by glyph id, non-zero means used). Glyph 0 and the
+// components of used composite glyphs are always kept. Glyph ids, cmap and
+// hmtx are left as they are, so metrics and text encoding don't change; unused
+// glyphs just become empty. Returns an empty string if the font can't be read.
+std::string subsetTrueTypeFont(std::string_view font, const std::vector<uint8_t> &usedGlyphs);
+
+#endif
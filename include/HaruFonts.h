@@ -0,0 +1,18 @@
+#ifndef HARUFONTS_H
+#define HARUFONTS_H
+
+#include <hpdf.h>
+#include <string_view>
+
+// Registers TrueType font data that is already in memory with pdf, the
+// in-memory counterpart of HPDF_LoadTTFontFromFile. libharu has no public
+// entry point for this, so it goes through the same internal calls the file
+// loader uses; CMakeLists.txt checks the internals it touches. The data is
+// copied into the document and libharu parses its tables again for every
+// document, only layout measures with FontCache's parse. Returns the font
+// name to pass to HPDF_GetFont, or nullptr on failure. With embedding every
+// glyph of the data is embedded, so it should be a subset (see
+// FontSubsetter.h).
+const char *loadTTFontFromMemory(HPDF_Doc pdf, std::string_view fontData, bool embedding);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef HARUIMAGES_H
+#define HARUIMAGES_H
+
+#include <hpdf.h>
+#include <string_view>
+
+// Embeds a JPEG or PNG file held in memory as an image XObject of pdf, without
+// decoding it where PDF can take the compressed data as is. 8-bit JPEGs go in
+// behind DCTDecode. The IDAT stream of a PNG without alpha, transparency or
+// interlacing goes in behind FlateDecode with the PNG predictors; libharu's
+// own loaders can't do that, so this builds the dictionary through its
+// internal object calls. Other PNGs are decoded by HPDF_LoadPngImageFromMem.
+// The data is copied into the document. Returns nullptr on failure.
+HPDF_Image loadImageFromMemory(HPDF_Doc pdf, std::string_view data);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef HARUPAGES_H
+#define HARUPAGES_H
+
+#include <hpdf.h>
+#include <string_view>
+
+// Page content built outside libharu. Pages are added with HPDF_AddPage as
+// usual, but their operators are formatted and deflated by the emitter on
+// several cores and copied in afterwards. libharu has no public entry point
+// for that, so these go through the internal calls its operators use.
+
+// Name the page's resources know font by, e.g. "F1". The font is added to
+// the resources on first use, as HPDF_Page_SetFontAndSize does.
+const char *pageFontName(HPDF_Page page, HPDF_Font font);
+
+// Same for an image XObject, e.g. "X1", as HPDF_Page_DrawImage does
+const char *pageImageName(HPDF_Page page, HPDF_Image image);
+
+// Sets the content stream of a page nothing was drawn on yet to operators
+// that are deflated already
+bool setPageContents(HPDF_Page page, std::string_view deflated);
+
+// Makes a stream write its data unchanged behind /Filter /FlateDecode.
+// libharu only writes that entry for streams it deflates itself.
+void markDeflated(HPDF_Dict stream);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <string_view>
+
+// MurmurHash3 x64 128-bit. Not cryptographic, but at 128 bits an accidental
+// collision between two inputs is not a practical concern, and it hashes
+// several GB/s, so content can be used as a cache key directly.
+struct Hash128
+{
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const Hash128 &other) const { return low == other.low && high == other.high; }
+};
+
+Hash128 hash128(std::string_view data, uint64_t seed = 0);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef IMAGES_H
+#define IMAGES_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Images of one document. Relationship IDs from document.xml are resolved to
+// media parts through word/_rels/document.xml.rels, and every part gets one
+// ID however often and under however many relationships it is drawn, so the
+// PDF embeds it once.
+class ImageTable
+{
+public:
+    // relsXml may be empty, the document then draws no images
+    bool load(std::string_view relsXml);
+
+    // ID of the image relId points to, -1 if it isn't an image of the package
+    int imageId(std::string_view relId);
+
+    // Part names by image ID, e.g. "word/media/image1.png"
+    const std::vector<std::string> &parts() const { return parts_; }
+
+private:
+    std::unordered_map<std::string, std::string> targets_; // relationship ID -> part
+    std::unordered_map<std::string, int> ids_;             // part -> image ID
+    std::vector<std::string> parts_;
+};
+
+// What a PDF image dictionary needs from a JPEG's frame header
+struct JpegInfo
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int components = 0; // 1 gray, 3 YCbCr/RGB, 4 CMYK
+    int bitsPerComponent = 8;
+    int frame = 0xC0;   // SOF marker, the coding process
+    bool adobe = false; // an APP14 marker, CMYK data is then stored inverted
+
+    // 8-bit baseline or progressive Huffman, the only JPEGs DCTDecode reads
+    bool passThrough() const;
+};
+
+// Reads the markers up to the first SOF, the data itself is not decoded
+bool readJpegInfo(std::string_view data, JpegInfo &info);
+
+// A PNG split into its chunks. The zlib stream of the IDAT chunks is what a
+// PDF FlateDecode filter with the PNG predictors reads, so it can be copied
+// over unchanged whenever the PDF color spaces can express the pixels.
+struct PngInfo
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int bitDepth = 0;
+    int colorType = 0; // 0 gray, 2 RGB, 3 palette, 4 gray + alpha, 6 RGBA
+    bool interlaced = false;
+    bool transparency = false;             // has a tRNS chunk
+    std::string_view palette;              // PLTE payload
+    std::vector<std::string_view> idat;    // IDAT payloads in order, views into the file
+
+    // No alpha, no transparency and no interlacing
+    bool passThrough() const;
+
+    // Samples per pixel
+    int colors() const { return colorType == 2 ? 3 : 1; }
+};
+
+// Walks the chunks, false for anything that isn't a well-formed PNG
+bool readPngInfo(std::string_view data, PngInfo &info);
+
+#endif
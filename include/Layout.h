@@ -0,0 +1,128 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include "DocumentModel.h"
+#include "FontMetrics.h"
+
+// A4 portrait with the converter's fixed margins, in points
+struct PageGeometry
+{
+    float width = 595.276f;
+    float height = 841.89f;
+    float leftMargin = 50.0f;
+    float rightMargin = 50.0f;
+    float topMargin = 50.0f;
+    float bottomMargin = 50.0f;
+
+    float top() const { return height - topMargin; }
+};
+
+// Text drawn with one font, size and color starting at (x, y). The text
+// lives NUL-terminated in the owning text pool at textOffset.
+struct GlyphRun
+{
+    float x, y;
+    uint32_t textOffset;
+    uint32_t textLength;
+    float fontSize;
+    float r, g, b;
+    uint8_t fontId;
+};
+
+// Stroked line segment (table borders)
+struct Rule
+{
+    float x1, y1, x2, y2;
+};
+
+// An image drawn with its lower left corner at (x, y)
+struct PlacedImage
+{
+    float x, y;
+    float width, height;
+    uint32_t imageId; // index into Layout::imageParts
+};
+
+// Page-independent layout of one body element. For a paragraph each line is
+// a line of text with runs relative to its baseline, for a table each line is
+// a row with runs and rules relative to the top of the row. Blocks only depend
+// on the element and the available width, the Paginator decides where they land.
+// A block lives in the conversion's arena unless constructed without one.
+struct LayoutBlock
+{
+    explicit LayoutBlock(std::pmr::memory_resource *arena = std::pmr::get_default_resource())
+        : lines(arena), runs(arena), rules(arena), images(arena), text(arena)
+    {
+    }
+
+    enum Kind
+    {
+        PARAGRAPH,
+        TABLE
+    };
+
+    struct Line
+    {
+        float advance; // paragraph: distance down from the previous line, table: row height
+        float rise;    // paragraph: extra room above the line for images taller than its text
+        uint32_t firstRun, runCount;
+        uint32_t firstRule, ruleCount;
+        uint32_t firstImage, imageCount;
+    };
+
+    Kind kind = PARAGRAPH;
+    std::pmr::vector<Line> lines;
+    std::pmr::vector<GlyphRun> runs;
+    std::pmr::vector<Rule> rules;
+    std::pmr::vector<PlacedImage> images;
+    std::pmr::string text;
+    float trailing = 0.0f; // space after the block
+};
+
+struct LayoutPage
+{
+    uint32_t firstRun = 0, runCount = 0;
+    uint32_t firstRule = 0, ruleCount = 0;
+    uint32_t firstImage = 0, imageCount = 0;
+};
+
+// The whole document positioned on pages. Runs, rules and images of all
+// pages are stored contiguously, each page refers to its slice.
+struct Layout
+{
+    PageGeometry geometry;
+    std::vector<LayoutPage> pages;
+    std::vector<GlyphRun> runs;
+    std::vector<Rule> rules;
+    std::vector<PlacedImage> images;
+    std::string text;
+    std::vector<std::string> imageParts; // media part of each image ID, e.g. "word/media/image1.png"
+};
+
+// Line breaking and table measurement, the block is allocated from arena
+LayoutBlock layoutParagraph(TextMeasurer &measurer, const Paragraph &paragraph, const PageGeometry &geometry,
+                            std::pmr::memory_resource *arena);
+LayoutBlock layoutTable(TextMeasurer &measurer, const Table &table, const PageGeometry &geometry,
+                        std::pmr::memory_resource *arena);
+
+// Places blocks top to bottom, starting a new page whenever one runs out
+class Paginator
+{
+public:
+    explicit Paginator(Layout &layout);
+
+    void place(const LayoutBlock &block);
+
+private:
+    void newPage();
+    void placeLine(const LayoutBlock &block, const LayoutBlock::Line &line, float y, uint32_t textBase);
+
+    Layout &layout_;
+    float cursorY_;
+};
+
+#endif
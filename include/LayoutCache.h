@@ -0,0 +1,69 @@
+#ifndef LAYOUTCACHE_H
+#define LAYOUTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include "Hash.h"
+#include "Layout.h"
+
+// Process-wide cache of laid-out body elements. A block only depends on the
+// element's XML, the page geometry and the document's styles, so an unchanged paragraph or table in
+// a re-saved draft is placed straight from here, without parsing or measuring
+// it again. Pagination still runs over every block, it only copies positions.
+// Entries are evicted least recently used first once maxBytes is exceeded.
+class LayoutCache
+{
+public:
+    // Off until enabled. Call once at startup, before any conversion runs.
+    static void enable(size_t maxBytes);
+
+    // nullptr while the cache is off
+    static LayoutCache *instance();
+
+    // stylesFingerprint is StyleTable::fingerprint() of the element's document
+    static Hash128 keyFor(std::string_view elementXml, const PageGeometry &geometry, uint64_t stylesFingerprint);
+
+    // The cached block, or null. The block stays valid while the caller holds it.
+    std::shared_ptr<const LayoutBlock> find(const Hash128 &key);
+
+    // Keeps a copy of block, which may live in a conversion's arena
+    void insert(const Hash128 &key, const LayoutBlock &block);
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+    Stats stats() const;
+
+private:
+    explicit LayoutCache(size_t maxBytes) : maxBytes_(maxBytes) {}
+
+    struct KeyHash
+    {
+        size_t operator()(const Hash128 &key) const { return static_cast<size_t>(key.low); }
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<const LayoutBlock> block;
+        size_t size;
+        std::list<Hash128>::iterator recency;
+    };
+
+    size_t maxBytes_;
+    mutable std::mutex mutex_;
+    std::list<Hash128> recency_; // most recently used first
+    std::unordered_map<Hash128, Entry, KeyHash> entries_;
+    Stats stats_;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef LINEBREAK_H
+#define LINEBREAK_H
+
+#include <cstddef>
+#include <string_view>
+
+// Line break opportunities of UAX #14 inside a word, text that holds no
+// spaces. Returns the length of word's leading part that has to stay on one
+// line: the offset of the first break opportunity after its first code
+// point, or word.size() if there is none. CJK text breaks between
+// ideographs, and URLs break after '/' and '-'. Classes come from a
+// two-stage table generated at compile time, so each code point costs one
+// lookup there and one in the pair table.
+size_t unbreakablePrefix(std::string_view word);
+
+#endif
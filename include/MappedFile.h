@@ -0,0 +1,29 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    const unsigned char *data() const { return static_cast<const unsigned char *>(data_); }
+    size_t size() const { return size_; }
+    std::string_view view() const { return std::string_view(static_cast<const char *>(data_), size_); }
+
+private:
+    void *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Where a conversion spends its time. Stages can nest, cell measurement is
+// part of layout, so they don't add up to the total.
+enum MetricStage
+{
+    STAGE_UNZIP,        // central directory and part decompression
+    STAGE_XML_PARSE,    // body scan, tinyxml2 and the document model
+    STAGE_LAYOUT,       // line breaking, tables and pagination
+    STAGE_CELL_MEASURE, // table cell heights, inside layout
+    STAGE_EMIT,         // font registration and page content
+    STAGE_SAVE,         // HPDF_SaveToFile
+    STAGE_COUNT
+};
+
+enum MetricCounter
+{
+    COUNTER_BYTES_DECOMPRESSED,
+    COUNTER_XML_NODES,       // elements the model builder visited
+    COUNTER_TOKENS_MEASURED, // words and space runs measured
+    COUNTER_PAGES_EMITTED,
+    COUNTER_ALLOCATIONS,     // only counted when the allocation hook is linked in
+    COUNTER_ALLOCATED_BYTES,
+    COUNTER_LAYOUT_CACHE_HITS, // body elements placed from the layout cache
+    COUNTER_IMAGES_EMBEDDED,   // distinct images written into the PDF
+    COUNTER_COUNT
+};
+
+const char *metricStageName(MetricStage stage);
+const char *metricCounterName(MetricCounter counter);
+
+// Everything recorded for one conversion
+struct ConversionMetrics
+{
+    uint64_t stageNanos[STAGE_COUNT] = {};
+    uint64_t counters[COUNTER_COUNT] = {};
+    uint64_t totalNanos = 0;
+
+    // {"total_ms": ..., "stages_ms": {...}, "counters": {...}}
+    void writeJson(std::ostream &out) const;
+};
+
+// Metrics of the conversion running on this thread, nullptr when metrics are
+// off. Everything below is a no-op then, so instrumentation can stay in hot code.
+ConversionMetrics *currentMetrics();
+
+// Makes metrics the current conversion's metrics on this thread for the
+// lifetime of the scope and records the total time and allocations.
+// A null pointer leaves metrics off.
+class MetricsScope
+{
+public:
+    explicit MetricsScope(ConversionMetrics *metrics);
+    ~MetricsScope();
+    MetricsScope(const MetricsScope &) = delete;
+    MetricsScope &operator=(const MetricsScope &) = delete;
+
+private:
+    ConversionMetrics *metrics_;
+    ConversionMetrics *previous_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t allocations_;
+    uint64_t allocatedBytes_;
+};
+
+// Adds the time until destruction (or stop()) to a stage
+class StageTimer
+{
+public:
+    explicit StageTimer(MetricStage stage) : metrics_(currentMetrics()), stage_(stage)
+    {
+        if (metrics_)
+            start_ = std::chrono::steady_clock::now();
+    }
+    ~StageTimer() { stop(); }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    void stop()
+    {
+        if (!metrics_)
+            return;
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        metrics_->stageNanos[stage_] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        metrics_ = nullptr;
+    }
+
+private:
+    ConversionMetrics *metrics_;
+    MetricStage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline void countMetric(MetricCounter counter, uint64_t amount)
+{
+    if (ConversionMetrics *metrics = currentMetrics())
+        metrics->counters[counter] += amount;
+}
+
+// Allocation counts of the calling thread. They stay zero unless the
+// executable links in the operator new hook (AllocationHook.cpp); a library
+// must not replace the global allocator for its host.
+struct AllocationCounts
+{
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+AllocationCounts &threadAllocationCounts();
+extern bool allocationHookInstalled;
+
+// Batch aggregate: counter totals and a log2 histogram of each stage's time
+class MetricsAggregate
+{
+public:
+    void add(const ConversionMetrics &metrics);
+
+    // {"conversions": n, "counters": {...}, "histograms_ms": {...}}, bucket
+    // i counts conversions that took [2^(i-1), 2^i) ms in that stage
+    void writeJson(std::ostream &out) const;
+
+private:
+    static const int BUCKETS = 24;
+
+    static int bucketFor(uint64_t nanos);
+    static void writeHistogram(std::ostream &out, const uint64_t (&buckets)[BUCKETS]);
+
+    uint64_t conversions_ = 0;
+    uint64_t counters_[COUNTER_COUNT] = {};
+    uint64_t stageBuckets_[STAGE_COUNT][BUCKETS] = {};
+    uint64_t totalBuckets_[BUCKETS] = {};
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PDFEMITTER_H
+#define PDFEMITTER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include "Layout.h"
+
+// Reads a media part named in layout.imageParts into data, false if it can't.
+// Each part is read once per PDF, images the source can't provide are left out.
+using ImageSource = std::function<bool(const std::string &part, std::string &data)>;
+
+// Turns a finished layout into PDF operators with libharu and saves it.
+// All positioning decisions were made by the layout stage.
+bool writePdf(const Layout &layout, const std::string &outputPdfPath, const ImageSource &images = nullptr);
+
+// Same, but the finished file ends up in pdfBytes instead of on disk
+bool writePdfToMemory(const Layout &layout, std::string &pdfBytes, const ImageSource &images = nullptr);
+
+// Receives the serialized PDF front to back in chunks, returning false aborts the write
+using PdfSink = std::function<bool(const char *data, size_t size)>;
+
+// Same, but the file is handed to sink in chunks instead of being written to a path
+bool writePdfToSink(const Layout &layout, const PdfSink &sink, const ImageSource &images = nullptr);
+
+// Writes the PDF to an open descriptor such as stdout, a pipe or a socket. fd is not closed.
+bool writePdfToFd(const Layout &layout, int fd, const ImageSource &images = nullptr);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// On-disk cache of finished PDFs, addressed by the content of the DOCX they
+// were converted from. Every entry is one <key>.pdf file in the directory; a
+// file's modification time records when it was last used, so the LRU order
+// survives restarts. Once the stored PDFs exceed maxBytes the least recently
+// used ones are deleted. Safe to share between the threads of one process.
+class ResultCache
+{
+public:
+    ResultCache(const std::string &directory, uint64_t maxBytes);
+
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    // Creates the directory if needed and indexes the entries already in it
+    bool open();
+
+    // 128-bit hash of the DOCX bytes, seeded with the converter version and
+    // build id, CACHE_FORMAT, the libharu and zlib versions and a fingerprint
+    // of the font files, so a rebuilt converter or replaced fonts never serve
+    // PDFs rendered before. Conversion options that change the output must be
+    // mixed in here as well once there are any.
+    static std::string keyFor(std::string_view docxBytes);
+
+    // On a hit the PDF is copied out and the entry becomes the most recently used
+    bool lookup(const std::string &key, std::string &pdfBytes);
+
+    // Adds the PDF under key, then evicts until the cache fits maxBytes again
+    void store(const std::string &key, std::string_view pdfBytes);
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stores = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+    Stats stats() const;
+
+    // One line with the counters, to size the cache
+    void printStats(std::ostream &out) const;
+
+private:
+    struct Entry
+    {
+        uint64_t size;
+        std::list<std::string>::iterator recency;
+    };
+
+    std::string pathFor(const std::string &key) const;
+    void evictLocked();
+
+    std::string directory_;
+    uint64_t maxBytes_;
+
+    mutable std::mutex mutex_;
+    std::list<std::string> recency_; // most recently used first
+    std::unordered_map<std::string, Entry> entries_;
+    Stats stats_;
+    uint64_t tempCounter_ = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef STYLETABLE_H
+#define STYLETABLE_H
+
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tinyxml2
+{
+class XMLElement;
+}
+
+// Run formatting as written at one level of the style hierarchy. Unset fields
+// are taken from the level below: docDefaults -> paragraph style -> character
+// style -> direct formatting.
+struct RunProps
+{
+    int8_t bold = -1; // -1 unset, 0 off, 1 on
+    int8_t italic = -1;
+    int32_t color = -1;     // 0xRRGGBB, -1 unset or auto
+    int32_t halfPoints = 0; // font size, 0 unset
+
+    // Fields set in over replace the ones here
+    void overlay(const RunProps &over);
+};
+
+// Leading decimal digits of an attribute value, 0 if there are none ("-1"
+// too). Saturates instead of overflowing and never throws.
+int32_t parseUnsigned(const char *text);
+
+// Reads a <w:rPr>, from a run or a style. rStyle receives the run's
+// character style ID if it names one.
+RunProps readRunProps(const tinyxml2::XMLElement *rPr, const char **rStyle = nullptr);
+
+// List membership of a paragraph, numId 0 means not numbered
+struct NumberingRef
+{
+    int numId = 0;
+    int level = 0;
+};
+
+// Reads the w:numPr of a <w:pPr>, present tells whether it has one. numId is
+// -1 when the numPr only sets the level.
+NumberingRef readNumPr(const tinyxml2::XMLElement *pPr, bool &present);
+
+// styles.xml and numbering.xml of one document, flattened when loaded. Every
+// paragraph style holds its complete run formatting with docDefaults and its
+// basedOn chain already applied, every character style the overrides of its
+// chain, so resolving a run costs one lookup by style ID and two overlays.
+class StyleTable
+{
+public:
+    StyleTable();
+
+    // The ID maps hold views into ids_, which a copy or move would leave behind
+    StyleTable(const StyleTable &) = delete;
+    StyleTable &operator=(const StyleTable &) = delete;
+
+    // Either part may be empty, missing styles then fall back to the defaults
+    bool load(std::string_view stylesXml, std::string_view numberingXml);
+
+    // Index of the paragraph style with this w:pStyle value, the document's
+    // default paragraph style for null or unknown IDs
+    uint16_t paragraphStyle(const char *styleId) const;
+
+    // Index of a character style, NO_STYLE if there is none with this ID
+    uint16_t characterStyle(const char *styleId) const;
+    static const uint16_t NO_STYLE = 0xFFFF;
+
+    const RunProps &runProps(uint16_t style) const { return styles_[style].runProps; }
+    NumberingRef numbering(uint16_t style) const { return styles_[style].numbering; }
+
+    // Hash of both parts, two documents with equal styles lay out alike
+    uint64_t fingerprint() const { return fingerprint_; }
+
+    // Cheap check on an element's XML: false means it holds no numbered paragraph
+    bool mayBeNumbered(std::string_view elementXml) const;
+
+    struct Level
+    {
+        int start = 1;
+        std::string format = "decimal"; // w:numFmt
+        std::string text;               // w:lvlText, e.g. "%1." or a bullet
+    };
+    static const int MAX_LEVELS = 9;
+
+    // The levels of a list, nullptr for an unknown numId
+    const std::array<Level, MAX_LEVELS> *levels(int numId) const;
+
+private:
+    struct Style
+    {
+        RunProps runProps;
+        NumberingRef numbering;
+    };
+
+    void loadStyles(std::string_view stylesXml);
+    void loadNumbering(std::string_view numberingXml);
+
+    std::vector<Style> styles_; // [0] is docDefaults alone
+    std::vector<std::string> ids_;
+    std::unordered_map<std::string_view, uint16_t> paragraphIds_; // views into ids_
+    std::unordered_map<std::string_view, uint16_t> characterIds_;
+    uint16_t defaultParagraph_ = 0;
+    bool numberedStyles_ = false;
+    std::unordered_map<int, std::array<Level, MAX_LEVELS>> lists_;
+    uint64_t fingerprint_ = 0;
+};
+
+// Paragraph numbers of one conversion, advanced in document order
+class ListCounters
+{
+public:
+    explicit ListCounters(const StyleTable &styles) : styles_(styles) {}
+
+    // Marker of the next paragraph in the list, e.g. "3." or a bullet. Empty
+    // when the list is unknown or its level shows no marker.
+    std::string next(NumberingRef ref);
+
+private:
+    static const int NOT_STARTED = INT_MIN;
+
+    const StyleTable &styles_;
+    std::unordered_map<int, std::array<int, StyleTable::MAX_LEVELS>> counts_;
+};
+
+#endif
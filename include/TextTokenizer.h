@@ -0,0 +1,42 @@
+#ifndef TEXTTOKENIZER_H
+#define TEXTTOKENIZER_H
+
+#include <cstddef>
+#include <string_view>
+
+// A span of the text being wrapped, pointing into it
+struct TextToken
+{
+    enum Kind
+    {
+        WORD,   // a word up to its next break opportunity, may hold no-break spaces
+        SPACE,  // spaces a line can wrap after
+        NEWLINE // a single '\n'
+    };
+
+    Kind kind = WORD;
+    std::string_view text;
+};
+
+// Splits UTF-8 text into words, runs of spaces and newlines for the wrapping
+// loops. Words come in pieces a line may wrap between, see LineBreak.h.
+// Spaces are the ASCII whitespace characters and the Unicode spaces a line
+// may break at (U+1680, U+2000-U+200A, U+2028, U+2029, U+205F, U+3000).
+// The no-break spaces U+00A0, U+2007 and U+202F stay inside their word.
+// Tokens always end on a code point boundary. The scan looks at 16 bytes at
+// a time with SSE2 (32 with AVX2) and falls back to bytes elsewhere.
+class TextTokenizer
+{
+public:
+    explicit TextTokenizer(std::string_view text) : text_(text) {}
+
+    // The next token, false once the text is used up
+    bool next(TextToken &token);
+
+private:
+    std::string_view text_;
+    size_t pos_ = 0;
+    size_t wordEnd_ = 0; // end of the word being handed out piece by piece
+};
+
+#endif
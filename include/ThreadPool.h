@@ -0,0 +1,69 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool where every worker owns a task deque. Workers pop their own
+// deque from the back and steal from the front of the others when it runs dry,
+// so uneven tasks (one huge document among many small ones) keep all cores busy.
+class ThreadPool
+{
+public:
+    // threadCount == 0 uses one thread per hardware core
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Tasks submitted from inside a worker go to that worker's own deque
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished
+    void wait();
+
+    size_t size() const { return threads_.size(); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool takeTask(size_t index, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_; // signalled when work is queued or on shutdown
+    std::condition_variable idle_; // signalled when pending_ drops to zero
+    long queued_ = 0;              // tasks sitting in some deque
+    size_t pending_ = 0;           // queued plus running
+    size_t nextQueue_ = 0;
+    bool stopping_ = false;
+};
+
+// The process-wide pool parallelFor shares work with, for background work that
+// overlaps the calling thread. nullptr on a single core and inside a worker of
+// a multi-threaded pool, where documents already run side by side.
+ThreadPool *helperPool();
+
+// Runs body(begin, end) over [0, count) in chunks of at least grain items. The
+// chunks are shared between a process-wide helper pool and the calling thread,
+// which keeps taking chunks itself, so a busy helper pool never stalls it.
+// Inside a worker of a multi-threaded pool (batch mode, the server) documents
+// already run side by side and the loop stays on the calling thread. If body
+// throws, the first exception is rethrown on the calling thread once every
+// chunk has finished or been skipped.
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &body);
+
+#endif
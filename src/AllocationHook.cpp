@@ -0,0 +1,33 @@
+#include "Metrics.h"
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocator to count allocations per thread for the
+// metrics. Only executables link this file, never the converter sources a
+// host program might embed.
+
+[[maybe_unused]] static const bool installed = (allocationHookInstalled = true);
+
+void *operator new(std::size_t size)
+{
+    AllocationCounts &counts = threadAllocationCounts();
+    counts.allocations++;
+    counts.bytes += size;
+
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,254 @@
+#include "BatchConverter.h"
+#include "DocxParser.h"
+#include "DocxToPdfConverter.h"
+#include "Metrics.h"
+#include "ResultCache.h"
+#include "ThreadPool.h"
+#include <boost/filesystem.hpp>
+#include <glob.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+namespace fs = boost::filesystem;
+
+static bool is_docx(const fs::path &path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".docx";
+}
+
+// Paths go into the metrics JSON as strings
+static void write_json_string(std::ostream &out, const std::string &value)
+{
+    out << '"';
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec
+                << std::setfill(' ');
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+static std::string pdf_path_for(const fs::path &relative, const std::string &outputDir)
+{
+    fs::path out = fs::path(outputDir) / relative;
+    out.replace_extension(".pdf");
+    return out.string();
+}
+
+bool collect_batch_jobs(const std::string &source, const std::string &outputDir,
+                        std::vector<BatchJob> &jobs)
+{
+    boost::system::error_code ec;
+
+    // Manifest file
+    if (!source.empty() && source[0] == '@')
+    {
+        std::ifstream manifest(source.substr(1));
+        if (!manifest.is_open())
+        {
+            std::cerr << "Failed to open manifest: " << source.substr(1) << std::endl;
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            size_t tab = line.find('\t');
+            BatchJob job;
+            job.inputPath = line.substr(0, tab);
+            job.outputPath = tab != std::string::npos
+                                 ? line.substr(tab + 1)
+                                 : pdf_path_for(fs::path(job.inputPath).filename(), outputDir);
+            jobs.push_back(job);
+        }
+        return true;
+    }
+
+    // Directory, mirrored into outputDir
+    if (fs::is_directory(source, ec))
+    {
+        for (fs::recursive_directory_iterator it(source, ec), end; it != end; it.increment(ec))
+        {
+            if (ec)
+            {
+                std::cerr << "Failed to read directory entry under " << source << ": " << ec.message() << std::endl;
+                return false;
+            }
+            if (!fs::is_regular_file(it->path(), ec) || !is_docx(it->path()))
+                continue;
+
+            BatchJob job;
+            job.inputPath = it->path().string();
+            job.outputPath = pdf_path_for(fs::relative(it->path(), source, ec), outputDir);
+            jobs.push_back(job);
+        }
+        return true;
+    }
+
+    // Glob pattern (also covers a single plain file path)
+    // Freed on every path, a failed glob may still hold a partial result
+    struct GlobGuard
+    {
+        glob_t matches = {};
+        ~GlobGuard() { globfree(&matches); }
+    } guard;
+    glob_t &matches = guard.matches;
+    int rc = glob(source.c_str(), 0, nullptr, &matches);
+    if (rc == GLOB_NOMATCH)
+    {
+        std::cerr << "No files match " << source << std::endl;
+        return false;
+    }
+    if (rc != 0)
+    {
+        std::cerr << "Failed to expand " << source << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < matches.gl_pathc; ++i)
+    {
+        fs::path path(matches.gl_pathv[i]);
+        if (!fs::is_regular_file(path, ec) || !is_docx(path))
+            continue;
+
+        BatchJob job;
+        job.inputPath = path.string();
+        job.outputPath = pdf_path_for(path.filename(), outputDir);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+size_t run_batch(const std::vector<BatchJob> &jobs, size_t threadCount, const std::string &metricsPath,
+                 ResultCache *cache)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<size_t> failures(0);
+    std::atomic<unsigned long long> inputBytes(0);
+    std::atomic<unsigned long long> outputBytes(0);
+    std::mutex reportMutex;
+
+    // Metrics are only collected when asked for, one JSON object per line
+    std::ofstream metricsFile;
+    std::ostream *metricsOut = nullptr;
+    MetricsAggregate aggregate;
+    if (metricsPath == "-")
+    {
+        metricsOut = &std::cerr;
+    }
+    else if (!metricsPath.empty())
+    {
+        metricsFile.open(metricsPath);
+        if (!metricsFile.is_open())
+        {
+            std::cerr << "Failed to open metrics file " << metricsPath << std::endl;
+            return jobs.size();
+        }
+        metricsOut = &metricsFile;
+    }
+
+    auto start = Clock::now();
+    {
+        // Every task builds its own archive, parser state and HPDF_Doc, so the
+        // workers share nothing but the report stream
+        ThreadPool pool(threadCount);
+        std::cout << "Converting " << jobs.size() << " files on " << pool.size() << " threads" << std::endl;
+
+        for (const BatchJob &job : jobs)
+        {
+            pool.submit([&job, &failures, &inputBytes, &outputBytes, &reportMutex, metricsOut, &aggregate, cache]() {
+                boost::system::error_code ec;
+                auto fileStart = Clock::now();
+
+                ConversionMetrics metrics;
+                bool ok;
+                bool cached = false;
+                {
+                    MetricsScope scope(metricsOut ? &metrics : nullptr);
+                    size_t slash = job.outputPath.find_last_of("/\\");
+                    ok = (slash == std::string::npos || create_directories(job.outputPath.substr(0, slash))) &&
+                         convertDocx(job.inputPath, job.outputPath, cache, &cached);
+                }
+
+                double ms = std::chrono::duration<double, std::milli>(Clock::now() - fileStart).count();
+                unsigned long long inSize = fs::file_size(job.inputPath, ec);
+                if (ec)
+                    inSize = 0;
+                unsigned long long outSize = ok ? fs::file_size(job.outputPath, ec) : 0;
+                if (ec)
+                    outSize = 0;
+
+                if (ok)
+                {
+                    inputBytes += inSize;
+                    outputBytes += outSize;
+                }
+                else
+                {
+                    failures++;
+                }
+
+                std::lock_guard<std::mutex> lock(reportMutex);
+                std::cout << (ok ? "[ok]   " : "[fail] ") << std::fixed << std::setprecision(1)
+                          << std::setw(9) << ms << " ms  "
+                          << std::setw(9) << inSize / 1024.0 << " KB  "
+                          << job.inputPath << " -> " << job.outputPath << (cached ? " (cached)" : "") << std::endl;
+
+                if (metricsOut)
+                {
+                    aggregate.add(metrics);
+                    *metricsOut << "{\"input\": ";
+                    write_json_string(*metricsOut, job.inputPath);
+                    *metricsOut << ", \"output\": ";
+                    write_json_string(*metricsOut, job.outputPath);
+                    *metricsOut << ", \"ok\": " << (ok ? "true" : "false") << ", \"metrics\": ";
+                    metrics.writeJson(*metricsOut);
+                    *metricsOut << "}\n";
+                }
+            });
+        }
+
+        pool.wait();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    size_t succeeded = jobs.size() - failures;
+    std::cout << std::fixed << std::setprecision(2)
+              << "Converted " << succeeded << "/" << jobs.size() << " files in " << seconds << " s ("
+              << (seconds > 0 ? succeeded / seconds : 0.0) << " files/s, "
+              << (seconds > 0 ? inputBytes / seconds / (1024.0 * 1024.0) : 0.0) << " MB/s in, "
+              << (seconds > 0 ? outputBytes / seconds / (1024.0 * 1024.0) : 0.0) << " MB/s out)"
+              << std::endl;
+    if (cache)
+    {
+        cache->printStats(std::cout);
+    }
+
+    if (metricsOut)
+    {
+        *metricsOut << "{\"aggregate\": ";
+        aggregate.writeJson(*metricsOut);
+        *metricsOut << "}" << std::endl;
+    }
+
+    return failures;
+}
@@ -0,0 +1,183 @@
+#include "BodyReader.h"
+
+static bool isNameEnd(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '/' || c == '>';
+}
+
+bool BodyReader::scanTag(size_t &pos, TagKind &kind, std::string_view &name)
+{
+    std::string_view rest = xml_.substr(pos);
+    size_t end;
+
+    if (rest.compare(0, 4, "<!--") == 0)
+    {
+        kind = TAG_OTHER;
+        end = xml_.find("-->", pos + 4);
+        if (end == std::string_view::npos)
+            return false;
+        pos = end + 3;
+        return true;
+    }
+    if (rest.compare(0, 9, "<![CDATA[") == 0)
+    {
+        kind = TAG_OTHER;
+        end = xml_.find("]]>", pos + 9);
+        if (end == std::string_view::npos)
+            return false;
+        pos = end + 3;
+        return true;
+    }
+    if (rest.compare(0, 2, "<?") == 0)
+    {
+        kind = TAG_OTHER;
+        end = xml_.find("?>", pos + 2);
+        if (end == std::string_view::npos)
+            return false;
+        pos = end + 2;
+        return true;
+    }
+    if (rest.compare(0, 2, "<!") == 0)
+    {
+        kind = TAG_OTHER;
+        end = xml_.find('>', pos + 2);
+        if (end == std::string_view::npos)
+            return false;
+        pos = end + 1;
+        return true;
+    }
+
+    size_t nameStart = pos + 1;
+    kind = TAG_START;
+    if (rest.compare(0, 2, "</") == 0)
+    {
+        kind = TAG_END;
+        nameStart++;
+    }
+
+    size_t nameEnd = nameStart;
+    while (nameEnd < xml_.size() && !isNameEnd(xml_[nameEnd]))
+        nameEnd++;
+    name = xml_.substr(nameStart, nameEnd - nameStart);
+
+    // Find the closing '>' skipping over quoted attribute values, which may contain it
+    char quote = 0;
+    for (end = nameEnd; end < xml_.size(); ++end)
+    {
+        char c = xml_[end];
+        if (quote)
+        {
+            if (c == quote)
+                quote = 0;
+        }
+        else if (c == '"' || c == '\'')
+        {
+            quote = c;
+        }
+        else if (c == '>')
+        {
+            break;
+        }
+    }
+    if (end >= xml_.size())
+        return false;
+
+    if (kind == TAG_START && xml_[end - 1] == '/')
+        kind = TAG_EMPTY;
+
+    pos = end + 1;
+    return true;
+}
+
+bool BodyReader::open()
+{
+    pos_ = 0;
+    inBody_ = false;
+    failed_ = false;
+
+    TagKind kind;
+    std::string_view name;
+    while ((pos_ = xml_.find('<', pos_)) != std::string_view::npos)
+    {
+        if (!scanTag(pos_, kind, name))
+        {
+            failed_ = true;
+            return false;
+        }
+        if (name == "w:body" && (kind == TAG_START || kind == TAG_EMPTY))
+        {
+            // An empty <w:body/> is valid, there is just nothing to hand out
+            inBody_ = kind == TAG_START;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BodyReader::next(std::string_view &element)
+{
+    if (!inBody_)
+        return false;
+
+    TagKind kind;
+    std::string_view name;
+
+    // Skip whitespace, comments and processing instructions between elements
+    size_t start;
+    for (;;)
+    {
+        start = xml_.find('<', pos_);
+        if (start == std::string_view::npos)
+        {
+            failed_ = true;
+            inBody_ = false;
+            return false;
+        }
+
+        pos_ = start;
+        if (!scanTag(pos_, kind, name))
+        {
+            failed_ = true;
+            inBody_ = false;
+            return false;
+        }
+
+        if (kind == TAG_END)
+        {
+            // </w:body>
+            inBody_ = false;
+            return false;
+        }
+        if (kind != TAG_OTHER)
+            break;
+    }
+
+    // Walk to the matching end tag, counting nested start tags
+    int depth = kind == TAG_START ? 1 : 0;
+    while (depth > 0)
+    {
+        size_t tag = xml_.find('<', pos_);
+        if (tag == std::string_view::npos)
+        {
+            failed_ = true;
+            inBody_ = false;
+            return false;
+        }
+
+        pos_ = tag;
+        if (!scanTag(pos_, kind, name))
+        {
+            failed_ = true;
+            inBody_ = false;
+            return false;
+        }
+
+        if (kind == TAG_START)
+            depth++;
+        else if (kind == TAG_END)
+            depth--;
+    }
+
+    element = xml_.substr(start, pos_ - start);
+    return true;
+}
@@ -0,0 +1,470 @@
+#include "ConversionServer.h"
+#include "Converter.h"
+#include "ResultCache.h"
+#include "ThreadPool.h"
+#include <boost/filesystem.hpp>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+// Set from the signal handler, read by the accept loop and the workers. A
+// lock-free atomic is safe to store to from a handler.
+static std::atomic<bool> signalled{false};
+
+static void onSignal(int)
+{
+    signalled = true;
+}
+
+static bool readFully(int fd, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = ::read(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        // MSG_NOSIGNAL: a client that went away is an error, not a SIGPIPE
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool writeMessage(int fd, char type, const char *payload, size_t size)
+{
+    unsigned char header[5] = {static_cast<unsigned char>(type), static_cast<unsigned char>(size >> 24),
+                               static_cast<unsigned char>(size >> 16), static_cast<unsigned char>(size >> 8),
+                               static_cast<unsigned char>(size)};
+    return writeFully(fd, reinterpret_cast<const char *>(header), sizeof(header)) && writeFully(fd, payload, size);
+}
+
+// Returns false on EOF or a malformed header, eof tells a clean close apart
+static bool readMessage(int fd, char &type, std::string &payload, bool &eof)
+{
+    unsigned char header[5];
+    eof = false;
+
+    ssize_t n;
+    do
+    {
+        n = ::read(fd, header, 1);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0)
+    {
+        eof = true;
+        return false;
+    }
+    if (n < 0 || !readFully(fd, reinterpret_cast<char *>(header) + 1, 4))
+        return false;
+
+    type = static_cast<char>(header[0]);
+    uint32_t size = (static_cast<uint32_t>(header[1]) << 24) | (static_cast<uint32_t>(header[2]) << 16) |
+                    (static_cast<uint32_t>(header[3]) << 8) | header[4];
+    if (size > protocol::MAX_PAYLOAD)
+        return false;
+
+    payload.resize(size);
+    return size == 0 || readFully(fd, &payload[0], size);
+}
+
+static int connectTo(const std::string &socketPath)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        std::cerr << "Failed to connect to " << socketPath << ": " << strerror(errno) << std::endl;
+        if (fd >= 0)
+            ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+ConversionServer::ConversionServer(const ServerOptions &options)
+    : options_(options), converter_(ConverterOptions{options.cacheDir, options.cacheBytes})
+{
+}
+
+ConversionServer::~ConversionServer()
+{
+    if (listenFd_ >= 0)
+    {
+        ::close(listenFd_);
+        ::unlink(options_.socketPath.c_str());
+    }
+}
+
+void ConversionServer::stop()
+{
+    stopping_ = true;
+    slotFreed_.notify_all();
+}
+
+bool ConversionServer::run()
+{
+    // Warm the font cache before the first request needs it
+    Diagnostics diagnostics;
+    if (!converter_.open(diagnostics))
+    {
+        std::cerr << diagnostics.message << std::endl;
+        return false;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (options_.socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path too long: " << options_.socketPath << std::endl;
+        return false;
+    }
+    strcpy(address.sun_path, options_.socketPath.c_str());
+
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0)
+    {
+        std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // A socket file left behind by a previous run would make bind fail
+    ::unlink(options_.socketPath.c_str());
+    // Owner only: a request names files the server reads and writes with its
+    // own permissions. Set before listen, so no one can connect in between.
+    if (::bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::chmod(options_.socketPath.c_str(), 0600) != 0 || ::listen(listenFd_, 64) != 0)
+    {
+        std::cerr << "Failed to listen on " << options_.socketPath << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    ThreadPool pool(options_.threads);
+    size_t capacity = pool.size() + (options_.maxQueued ? options_.maxQueued : pool.size() * 2);
+    std::cout << "Listening on " << options_.socketPath << " with " << pool.size() << " workers, up to "
+              << capacity << " connections in flight" << std::endl;
+
+    while (!stopping_ && !signalled)
+    {
+        // Backpressure: don't accept while every slot is taken
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!slotFreed_.wait_for(lock, std::chrono::milliseconds(250),
+                                     [&]() { return connections_.size() < capacity || stopping_; }))
+            {
+                continue;
+            }
+        }
+
+        // Poll with a timeout so a signal or stop() is noticed promptly
+        pollfd pfd = {listenFd_, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, 250);
+        if (ready <= 0)
+        {
+            continue;
+        }
+
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno != EINTR && errno != EAGAIN)
+            {
+                std::cerr << "accept failed: " << strerror(errno) << std::endl;
+            }
+            continue;
+        }
+
+        // An idle client must not hold a worker forever
+        timeval timeout = {30, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.insert(fd);
+        }
+        pool.submit([this, fd]() { serveConnection(fd); });
+    }
+
+    // Let every connection finish its current request, idle ones see EOF
+    std::cout << "Shutting down" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int fd : connections_)
+        {
+            ::shutdown(fd, SHUT_RD);
+        }
+    }
+    pool.wait();
+    if (ResultCache *cache = converter_.cache())
+    {
+        cache->printStats(std::cout);
+    }
+    return true;
+}
+
+void ConversionServer::releaseSlot(int fd)
+{
+    // Forget the fd before closing it, accept may hand out the same number again
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(fd);
+    }
+    ::close(fd);
+    slotFreed_.notify_one();
+}
+
+void ConversionServer::serveConnection(int fd)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Closes the connection and frees its slot however this returns, a leaked
+    // slot would eventually stop the acceptor for good
+    struct SlotGuard
+    {
+        ConversionServer *server;
+        int fd;
+        ~SlotGuard() { server->releaseSlot(fd); }
+    } guard{this, fd};
+
+    char type;
+    std::string payload;
+    bool eof = false;
+    try
+    {
+        while (readMessage(fd, type, payload, eof))
+        {
+            auto start = Clock::now();
+            std::string summary;
+            bool ok = handleRequest(fd, type, payload, summary);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(logMutex_);
+                std::cout << (ok ? "[ok]   " : "[fail] ") << std::fixed << std::setprecision(1) << std::setw(9)
+                          << ms << " ms  " << summary << std::endl;
+            }
+            if (stopping_ || signalled)
+            {
+                break;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        // Out of memory on a large payload, most likely. Only this connection
+        // is given up. handleRequest writes nothing before it has its answer,
+        // so the error reply can't land in the middle of another one.
+        std::string error = std::string("internal error: ") + e.what();
+        writeMessage(fd, protocol::REPLY_ERROR, error.data(), error.size());
+        std::lock_guard<std::mutex> lock(logMutex_);
+        std::cerr << "Dropped connection after an " << error << std::endl;
+        return;
+    }
+
+    if (!eof && !stopping_ && !signalled)
+    {
+        std::lock_guard<std::mutex> lock(logMutex_);
+        std::cerr << "Dropped connection after a read error or malformed request" << std::endl;
+    }
+}
+
+bool ConversionServer::convertBytes(const std::string &docx, std::string &pdf, std::string &error,
+                                    std::ostringstream &description)
+{
+    ConvertResult result = converter_.convert(docx);
+    if (!result.ok())
+    {
+        error = std::string(convertErrorName(result.diagnostics.error)) + ": " + result.diagnostics.message;
+        description << " -> " << error;
+        return false;
+    }
+
+    pdf = std::move(result.pdf);
+    description << " -> " << pdf.size() / 1024.0 << " KB" << (result.cached ? " (cached)" : "");
+    for (const std::string &warning : result.diagnostics.warnings)
+    {
+        description << "; " << warning;
+    }
+    return true;
+}
+
+bool ConversionServer::handleRequest(int fd, char type, const std::string &payload, std::string &summary)
+{
+    std::ostringstream description;
+    description << std::fixed << std::setprecision(1);
+
+    bool converted = false;
+    std::string reply;
+    std::string error = "conversion failed";
+
+    if (type == protocol::REQUEST_DOCX)
+    {
+        description << "inline " << payload.size() / 1024.0 << " KB";
+        converted = convertBytes(payload, reply, error, description);
+    }
+    else if (type == protocol::REQUEST_FILE)
+    {
+        size_t separator = payload.find('\0');
+        std::string input = payload.substr(0, separator);
+        std::string output = separator == std::string::npos ? std::string() : payload.substr(separator + 1);
+        description << input;
+
+        if (output.empty())
+        {
+            std::ifstream in(input, std::ios::binary);
+            std::stringstream buffer;
+            if (in.is_open() && buffer << in.rdbuf())
+            {
+                converted = convertBytes(buffer.str(), reply, error, description);
+            }
+            else
+            {
+                error = "failed to read " + input;
+            }
+        }
+        else
+        {
+            ConvertResult result = converter_.convertFile(input, output);
+            converted = result.ok();
+            description << " -> ";
+            if (converted)
+            {
+                reply = output;
+                description << output << (result.cached ? " (cached)" : "");
+                for (const std::string &warning : result.diagnostics.warnings)
+                {
+                    description << "; " << warning;
+                }
+            }
+            else
+            {
+                error = std::string(convertErrorName(result.diagnostics.error)) + ": " + result.diagnostics.message;
+                description << error;
+            }
+        }
+    }
+    else
+    {
+        error = "unknown request type";
+        description << "request type " << static_cast<int>(static_cast<unsigned char>(type));
+    }
+
+    summary = description.str();
+    if (!converted)
+    {
+        writeMessage(fd, protocol::REPLY_ERROR, error.data(), error.size());
+        return false;
+    }
+    return writeMessage(fd, protocol::REPLY_OK, reply.data(), reply.size());
+}
+
+bool request_conversion(const std::string &socketPath, const std::string &input, const std::string &output,
+                        bool inlineBytes)
+{
+    std::string payload;
+    char type;
+    if (inlineBytes)
+    {
+        std::ifstream in(input, std::ios::binary);
+        if (!in.is_open())
+        {
+            std::cerr << "Failed to open " << input << std::endl;
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        payload = buffer.str();
+        type = protocol::REQUEST_DOCX;
+    }
+    else
+    {
+        // The server resolves paths against its own working directory
+        payload = fs::absolute(input).string();
+        payload += '\0';
+        payload += fs::absolute(output).string();
+        type = protocol::REQUEST_FILE;
+    }
+
+    if (payload.size() > protocol::MAX_PAYLOAD)
+    {
+        std::cerr << input << " is too large to send" << std::endl;
+        return false;
+    }
+
+    int fd = connectTo(socketPath);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char status;
+    std::string reply;
+    bool eof;
+    bool ok = writeMessage(fd, type, payload.data(), payload.size()) && readMessage(fd, status, reply, eof);
+    ::close(fd);
+
+    if (!ok)
+    {
+        std::cerr << "No reply from " << socketPath << std::endl;
+        return false;
+    }
+    if (status != protocol::REPLY_OK)
+    {
+        std::cerr << "Server failed to convert " << input << ": " << reply << std::endl;
+        return false;
+    }
+
+    if (inlineBytes)
+    {
+        std::ofstream out(output, std::ios::binary);
+        if (!out.write(reply.data(), reply.size()))
+        {
+            std::cerr << "Failed to write " << output << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,150 @@
+#include "Converter.h"
+#include "DocxParser.h"
+#include "DocxToPdfConverter.h"
+#include "FontCache.h"
+#include "ResultCache.h"
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <sstream>
+
+Converter::Converter(const ConverterOptions &options) : options_(options)
+{
+}
+
+Converter::~Converter() = default;
+
+bool Converter::open(Diagnostics &diagnostics)
+{
+    DiagnosticsScope scope(&diagnostics);
+    if (!FontCache::instance())
+    {
+        // The file that failed was reported already, the code says what it means
+        diagnostics.error = CONVERT_FONTS_UNAVAILABLE;
+        if (diagnostics.message.empty())
+        {
+            diagnostics.message = "No fonts in " + fontDirectory();
+        }
+        return false;
+    }
+
+    if (!options_.cacheDir.empty() && !cache_)
+    {
+        std::unique_ptr<ResultCache> cache(new ResultCache(options_.cacheDir, options_.cacheBytes));
+        if (!cache->open())
+        {
+            return false;
+        }
+        cache_ = std::move(cache);
+    }
+    return true;
+}
+
+ConvertResult Converter::convert(std::string_view docx) const
+{
+    ConvertResult result;
+    {
+        MetricsScope metricsScope(options_.metrics ? &result.metrics : nullptr);
+        DiagnosticsScope scope(&result.diagnostics);
+        run(docx, result);
+    }
+    return result;
+}
+
+ConvertResult Converter::convert(const void *data, size_t size) const
+{
+    return convert(std::string_view(static_cast<const char *>(data), size));
+}
+
+ConvertResult Converter::convertFile(const std::string &docxPath, const std::string &pdfPath) const
+{
+    ConvertResult result;
+    {
+        MetricsScope metricsScope(options_.metrics ? &result.metrics : nullptr);
+        DiagnosticsScope scope(&result.diagnostics);
+
+        // Read rather than mapped: a file truncated under a mapping is a
+        // SIGBUS, and the cache key needs every byte anyway
+        std::ifstream in(docxPath, std::ios::binary);
+        std::stringstream docx;
+        if (!in.is_open() || !(docx << in.rdbuf()))
+        {
+            reportError(CONVERT_IO_ERROR, "Failed to open " + docxPath);
+            return result;
+        }
+        run(docx.str(), result);
+        if (!result.ok())
+        {
+            return result;
+        }
+
+        // A full disk may only show when the buffer is flushed on close. A
+        // truncated PDF is worse than none, so it is removed.
+        std::ofstream out(pdfPath, std::ios::binary);
+        bool opened = out.is_open();
+        if (!out.write(result.pdf.data(), result.pdf.size()) || (out.close(), !out))
+        {
+            reportError(CONVERT_IO_ERROR, "Failed to save PDF to " + pdfPath);
+            if (opened)
+            {
+                std::remove(pdfPath.c_str());
+            }
+        }
+    }
+    result.pdf.clear();
+    return result;
+}
+
+void Converter::run(std::string_view docx, ConvertResult &result) const
+{
+    // Damaged input can still reach a throwing call somewhere, and memory can
+    // run out. Either comes back as an error code like any other failure,
+    // callers of the library never see an exception.
+    try
+    {
+        std::string key;
+        if (cache_)
+        {
+            key = ResultCache::keyFor(docx);
+            if (cache_->lookup(key, result.pdf))
+            {
+                result.cached = true;
+                return;
+            }
+        }
+
+        DocxArchive archive;
+        if (!archive.openFromBuffer(docx) || !generatePDFToMemory(archive, result.pdf))
+        {
+            // Every failure is reported where it happens, this only keeps a
+            // failed conversion from ever looking like a success
+            if (result.ok())
+            {
+                reportError(CONVERT_PDF_FAILED, "Conversion failed");
+            }
+            result.pdf.clear();
+            return;
+        }
+
+        // A part that couldn't be read but was only needed for styles or a
+        // picture left the document readable, so it ends up a warning
+        Diagnostics &diagnostics = result.diagnostics;
+        if (!diagnostics.message.empty())
+        {
+            diagnostics.warnings.insert(diagnostics.warnings.begin(), diagnostics.message);
+        }
+        diagnostics.error = CONVERT_OK;
+        diagnostics.message.clear();
+
+        if (cache_)
+        {
+            cache_->store(key, result.pdf);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        result.pdf.clear();
+        result.cached = false;
+        reportError(CONVERT_PDF_FAILED, std::string("internal error: ") + e.what());
+    }
+}
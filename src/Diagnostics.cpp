@@ -0,0 +1,65 @@
+#include "Diagnostics.h"
+#include <iostream>
+#include <mutex>
+
+static thread_local Diagnostics *tlsDiagnostics = nullptr;
+
+// Helpers of one conversion report into the same diagnostics. Reports are
+// rare, one lock for all of them is enough.
+static std::mutex diagnosticsMutex;
+
+const char *convertErrorName(ConvertError error)
+{
+    static const char *const names[CONVERT_ERROR_COUNT] = {"ok", "invalid_archive", "missing_document",
+                                                           "fonts_unavailable", "pdf_failed", "io_error"};
+    return names[error];
+}
+
+Diagnostics *currentDiagnostics()
+{
+    return tlsDiagnostics;
+}
+
+DiagnosticsScope::DiagnosticsScope(Diagnostics *diagnostics) : previous_(tlsDiagnostics)
+{
+    tlsDiagnostics = diagnostics;
+}
+
+DiagnosticsScope::~DiagnosticsScope()
+{
+    tlsDiagnostics = previous_;
+}
+
+void reportError(ConvertError error, const std::string &message)
+{
+    Diagnostics *diagnostics = tlsDiagnostics;
+    if (!diagnostics)
+    {
+        std::cerr << message << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(diagnosticsMutex);
+    if (diagnostics->error == CONVERT_OK)
+    {
+        diagnostics->error = error;
+        diagnostics->message = message;
+    }
+    else
+    {
+        diagnostics->warnings.push_back(message);
+    }
+}
+
+void reportWarning(const std::string &message)
+{
+    Diagnostics *diagnostics = tlsDiagnostics;
+    if (!diagnostics)
+    {
+        std::cerr << message << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(diagnosticsMutex);
+    diagnostics->warnings.push_back(message);
+}
@@ -0,0 +1,293 @@
+#include "DocumentModel.h"
+#include "Metrics.h"
+#include <tinyxml2.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+using namespace tinyxml2;
+
+static const int32_t MAX_GRID_SPAN = 63;
+
+bool RunFormatTable::FormatKey::operator==(const FormatKey &other) const
+{
+    return paragraphStyle == other.paragraphStyle && characterStyle == other.characterStyle &&
+           direct.bold == other.direct.bold && direct.italic == other.direct.italic &&
+           direct.color == other.direct.color && direct.halfPoints == other.direct.halfPoints;
+}
+
+size_t RunFormatTable::FormatKeyHash::operator()(const FormatKey &key) const
+{
+    uint64_t styles = key.paragraphStyle | static_cast<uint64_t>(key.characterStyle) << 16 |
+                      static_cast<uint64_t>(static_cast<uint8_t>(key.direct.bold)) << 32 |
+                      static_cast<uint64_t>(static_cast<uint8_t>(key.direct.italic)) << 40;
+    uint64_t values = static_cast<uint32_t>(key.direct.color) |
+                      static_cast<uint64_t>(static_cast<uint32_t>(key.direct.halfPoints)) << 32;
+    uint64_t hash = (styles ^ values * 0x9E3779B97F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+    return static_cast<size_t>(hash ^ hash >> 32);
+}
+
+RunFormat RunFormatTable::resolve(const XMLElement *rPr, uint16_t paragraphStyle)
+{
+    // The pass over rPr is needed to tell formats apart at all; what it read
+    // is the key, so a repeated format costs nothing more than that pass and
+    // a lookup of 16 bytes
+    const char *rStyle;
+    FormatKey key;
+    key.direct = readRunProps(rPr, &rStyle);
+    key.paragraphStyle = paragraphStyle;
+    key.characterStyle = styles_.characterStyle(rStyle);
+
+    auto it = formats_.find(key);
+    if (it != formats_.end())
+    {
+        return it->second;
+    }
+
+    RunFormat format = decode(key);
+    formats_.emplace(key, format);
+    return format;
+}
+
+// A run's formatting: its paragraph's, then its character style's, then its own <w:rPr>
+RunFormat RunFormatTable::decode(const FormatKey &key) const
+{
+    RunProps props = styles_.runProps(key.paragraphStyle);
+    if (key.characterStyle != StyleTable::NO_STYLE)
+    {
+        props.overlay(styles_.runProps(key.characterStyle));
+    }
+    props.overlay(key.direct);
+
+    RunFormat format;
+    bool isBold = props.bold > 0;
+    bool isItalic = props.italic > 0;
+    if (isBold && isItalic)
+    {
+        format.fontId = FONT_BOLD_ITALIC;
+    }
+    else if (isBold)
+    {
+        format.fontId = FONT_BOLD;
+    }
+    else if (isItalic)
+    {
+        format.fontId = FONT_ITALIC;
+    }
+
+    format.halfPoints = static_cast<uint16_t>(std::min(props.halfPoints, 0xFFFF));
+    format.rgb = props.color >= 0 ? static_cast<uint32_t>(props.color) : 0; // auto is black
+    return format;
+}
+
+// The paragraph style named by <w:pPr><w:pStyle>, or the default one
+static uint16_t paragraphStyle(XMLElement *pPr, const StyleTable &styles)
+{
+    XMLElement *pStyle = pPr ? pPr->FirstChildElement("w:pStyle") : nullptr;
+    return styles.paragraphStyle(pStyle ? pStyle->Attribute("w:val") : nullptr);
+}
+
+// The picture of an inline or floating <w:drawing>, false if it has none that
+// images knows. Floating pictures are drawn inline where they are anchored.
+static bool readDrawing(const XMLElement *drawing, ImageTable &images, ParagraphItem &item)
+{
+    const XMLElement *frame = drawing->FirstChildElement("wp:inline");
+    if (!frame)
+    {
+        frame = drawing->FirstChildElement("wp:anchor");
+    }
+    const XMLElement *extent = frame ? frame->FirstChildElement("wp:extent") : nullptr;
+    if (!extent)
+    {
+        return false;
+    }
+
+    const XMLElement *blip = frame->FirstChildElement("a:graphic");
+    const char *path[] = {"a:graphicData", "pic:pic", "pic:blipFill", "a:blip"};
+    for (const char *name : path)
+    {
+        blip = blip ? blip->FirstChildElement(name) : nullptr;
+    }
+    const char *relId = blip ? blip->Attribute("r:embed") : nullptr;
+    int id = relId ? images.imageId(relId) : -1;
+    if (id < 0)
+    {
+        return false;
+    }
+
+    // The extent is in EMUs, 12700 to the point
+    item.kind = ParagraphItem::IMAGE;
+    item.imageId = id;
+    item.imageWidth = extent->Int64Attribute("cx") / 12700.0f;
+    item.imageHeight = extent->Int64Attribute("cy") / 12700.0f;
+    return item.imageWidth > 0.0f && item.imageHeight > 0.0f;
+}
+
+Paragraph parseParagraph(XMLElement *pElement, std::pmr::memory_resource *arena, RunFormatTable &formats,
+                         ListCounters *counters, ImageTable *images)
+{
+    Paragraph paragraph(arena);
+    uint64_t visited = 1; // elements looked at, for the metrics
+
+    const StyleTable &styles = formats.styles();
+    XMLElement *pPr = pElement->FirstChildElement("w:pPr");
+    uint16_t style = paragraphStyle(pPr, styles);
+
+    // The paragraph mark's formatting, used for the list marker and for the
+    // spacing after a paragraph without runs
+    RunFormat markFormat = formats.resolve(pPr ? pPr->FirstChildElement("w:rPr") : nullptr, style);
+
+    // A list item starts with its marker and a tab, numPr on the paragraph overrides its style's
+    NumberingRef numbering = styles.numbering(style);
+    bool ownNumbering;
+    NumberingRef own = readNumPr(pPr, ownNumbering);
+    if (ownNumbering)
+    {
+        numbering.numId = own.numId >= 0 ? own.numId : numbering.numId;
+        numbering.level = own.level;
+    }
+    if (counters && numbering.numId > 0)
+    {
+        std::string marker = counters->next(numbering);
+        if (!marker.empty())
+        {
+            // The marker isn't in the DOM, it gets a copy in the arena
+            char *text = static_cast<char *>(arena->allocate(marker.size(), 1));
+            memcpy(text, marker.data(), marker.size());
+
+            ParagraphItem item;
+            item.fragment.format = markFormat;
+            item.fragment.text = std::string_view(text, marker.size());
+            paragraph.items.push_back(item);
+            item.kind = ParagraphItem::TAB;
+            paragraph.items.push_back(item);
+        }
+    }
+
+    int fontSize = markFormat.fontSize();
+
+    // For each run in the paragraph
+    for (XMLElement *run = pElement->FirstChildElement("w:r"); run; run = run->NextSiblingElement("w:r"))
+    {
+        visited++;
+        RunFormat format = formats.resolve(run->FirstChildElement("w:rPr"), style);
+        fontSize = format.fontSize();
+
+        // Iterate over child elements within the run
+        for (XMLElement *child = run->FirstChildElement(); child; child = child->NextSiblingElement())
+        {
+            visited++;
+            ParagraphItem item;
+            item.fragment.format = format;
+
+            if (strcmp(child->Name(), "w:t") == 0)
+            {
+                // Text element
+                if (!child->GetText())
+                {
+                    continue;
+                }
+                item.kind = ParagraphItem::TEXT;
+                item.fragment.text = child->GetText();
+            }
+            else if (strcmp(child->Name(), "w:tab") == 0)
+            {
+                item.kind = ParagraphItem::TAB;
+            }
+            else if (strcmp(child->Name(), "w:br") == 0)
+            {
+                item.kind = ParagraphItem::BREAK;
+            }
+            else if (images && strcmp(child->Name(), "w:drawing") == 0)
+            {
+                if (!readDrawing(child, *images, item))
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                continue;
+            }
+
+            paragraph.items.push_back(item);
+        }
+    }
+
+    paragraph.endFontSize = fontSize;
+    countMetric(COUNTER_XML_NODES, visited);
+    return paragraph;
+}
+
+Table parseTable(XMLElement *tblElement, std::pmr::memory_resource *arena, RunFormatTable &formats)
+{
+    const StyleTable &styles = formats.styles();
+    Table table(arena);
+    uint64_t visited = 1; // elements looked at, for the metrics
+
+    for (XMLElement *tr = tblElement->FirstChildElement("w:tr"); tr; tr = tr->NextSiblingElement("w:tr"))
+    {
+        visited++;
+        // Rows and cells are built in place, the row picks up the table's arena
+        std::pmr::vector<TableCell> &row = table.rows.emplace_back();
+
+        for (XMLElement *tc = tr->FirstChildElement("w:tc"); tc; tc = tc->NextSiblingElement("w:tc"))
+        {
+            visited++;
+            TableCell &cell = row.emplace_back(arena);
+
+            // Check for gridSpan
+            XMLElement *tcPr = tc->FirstChildElement("w:tcPr");
+            if (tcPr)
+            {
+                XMLElement *gridSpan = tcPr->FirstChildElement("w:gridSpan");
+                if (gridSpan && gridSpan->Attribute("w:val"))
+                {
+                    // Word tables have at most 63 columns, a larger span is damage
+                    int32_t span = parseUnsigned(gridSpan->Attribute("w:val"));
+                    cell.gridSpan = static_cast<size_t>(std::clamp(span, 1, MAX_GRID_SPAN));
+                }
+            }
+
+            // Iterate over paragraphs within the cell
+            for (XMLElement *para = tc->FirstChildElement("w:p"); para; para = para->NextSiblingElement("w:p"))
+            {
+                visited++;
+                uint16_t style = paragraphStyle(para->FirstChildElement("w:pPr"), styles);
+                for (XMLElement *run = para->FirstChildElement("w:r"); run; run = run->NextSiblingElement("w:r"))
+                {
+                    visited++;
+                    RunFormat format = formats.resolve(run->FirstChildElement("w:rPr"), style);
+
+                    // Iterate over child elements within the run
+                    for (XMLElement *child = run->FirstChildElement(); child; child = child->NextSiblingElement())
+                    {
+                        visited++;
+                        if (strcmp(child->Name(), "w:t") == 0)
+                        {
+                            // Text element
+                            if (child->GetText())
+                            {
+                                TextFragment fragment;
+                                fragment.format = format;
+                                fragment.text = child->GetText();
+                                cell.textFragments.push_back(fragment);
+                            }
+                        }
+                        else if (strcmp(child->Name(), "w:br") == 0)
+                        {
+                            // Line break within table cell
+                            TextFragment fragment;
+                            fragment.format = format;
+                            fragment.text = "\n";
+                            cell.textFragments.push_back(fragment);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    countMetric(COUNTER_XML_NODES, visited);
+    return table;
+}
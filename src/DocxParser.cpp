@@ -1,11 +1,25 @@
 #include "DocxParser.h"
+#include "Diagnostics.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
 #include <zip.h>
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <fstream>
 #include <sys/stat.h>
 #include <errno.h>
 #include <string.h>
 
+// A file that can't be read is an I/O problem, anything else zip_open
+// rejects isn't a ZIP archive
+static ConvertError openError(int zipError)
+{
+    bool io = zipError == ZIP_ER_NOENT || zipError == ZIP_ER_OPEN || zipError == ZIP_ER_READ;
+    return io ? CONVERT_IO_ERROR : CONVERT_INVALID_ARCHIVE;
+}
+
 // Function to recursively create directories
 bool create_directories(const std::string &path)
 {
@@ -24,7 +38,7 @@ bool create_directories(const std::string &path)
         }
         else
         {
-            std::cerr << "Path exists but is not a directory: " << path << std::endl;
+            reportError(CONVERT_IO_ERROR, "Path exists but is not a directory: " + path);
             return false;
         }
     }
@@ -45,40 +59,32 @@ bool create_directories(const std::string &path)
     {
         if (errno != EEXIST)
         {
-            std::cerr << "Failed to create directory: " << path << " Error: " << strerror(errno) << std::endl;
+            reportError(CONVERT_IO_ERROR, "Failed to create directory: " + path + " Error: " + strerror(errno));
             return false;
         }
     }
     return true;
 }
 
-// Uses libzip to extract contents of the DOCX file
-bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
+// Extracts entries [begin, end) of the DOCX through a handle of their own,
+// libzip handles can't be shared between threads
+static void extractEntries(const std::string &docx_path, const std::string &output_dir, zip_int64_t begin,
+                           zip_int64_t end)
 {
     int err;
     zip *zip_archive = zip_open(docx_path.c_str(), ZIP_RDONLY, &err);
     if (!zip_archive)
     {
-        std::cerr << "Failed to open DOCX file: " << docx_path << std::endl;
-        return false;
+        reportError(openError(err), "Failed to open DOCX file: " + docx_path);
+        return;
     }
 
-    // Create output directory if it doesn't exist
-    if (!create_directories(output_dir))
-    {
-        std::cerr << "Failed to create output directory: " << output_dir << std::endl;
-        zip_close(zip_archive);
-        return false;
-    }
-
-    // Extract all files from the DOCX archive
-    zip_int64_t num_entries = zip_get_num_entries(zip_archive, 0);
-    for (zip_int64_t i = 0; i < num_entries; ++i)
+    for (zip_int64_t i = begin; i < end; ++i)
     {
         const char *file_name = zip_get_name(zip_archive, i, 0);
         if (!file_name)
         {
-            std::cerr << "Failed to get name for entry " << i << std::endl;
+            reportError(CONVERT_INVALID_ARCHIVE, "Failed to get name for entry " + std::to_string(i));
             continue;
         }
 
@@ -94,7 +100,7 @@ bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
                 // It's a directory, create it
                 if (!create_directories(output_file_path))
                 {
-                    std::cerr << "Failed to create directory: " << output_file_path << std::endl;
+                    reportError(CONVERT_IO_ERROR, "Failed to create directory: " + output_file_path);
                     continue;
                 }
                 continue; // Move to the next entry
@@ -108,7 +114,7 @@ bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
             std::string dir = output_file_path.substr(0, last_slash);
             if (!create_directories(dir))
             {
-                std::cerr << "Failed to create directory: " << dir << std::endl;
+                reportError(CONVERT_IO_ERROR, "Failed to create directory: " + dir);
                 continue;
             }
         }
@@ -117,7 +123,7 @@ bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
         zip_file *zf = zip_fopen_index(zip_archive, i, 0);
         if (!zf)
         {
-            std::cerr << "Failed to open file in ZIP: " << file_name << std::endl;
+            reportError(CONVERT_INVALID_ARCHIVE, std::string("Failed to open file in ZIP: ") + file_name);
             continue;
         }
 
@@ -125,7 +131,7 @@ bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
         std::ofstream out_file(output_file_path, std::ios::binary);
         if (!out_file.is_open())
         {
-            std::cerr << "Failed to open output file: " << output_file_path << std::endl;
+            reportError(CONVERT_IO_ERROR, "Failed to open output file: " + output_file_path);
             zip_fclose(zf);
             continue;
         }
@@ -140,7 +146,7 @@ bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
 
         if (bytes_read < 0)
         {
-            std::cerr << "Error reading from ZIP file: " << file_name << std::endl;
+            reportError(CONVERT_INVALID_ARCHIVE, std::string("Error reading from ZIP file: ") + file_name);
         }
 
         zip_fclose(zf);
@@ -148,5 +154,431 @@ bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
     }
 
     zip_close(zip_archive);
+}
+
+// Uses libzip to extract contents of the DOCX file
+bool unzip_docx(const std::string &docx_path, const std::string &output_dir)
+{
+    int err;
+    zip *zip_archive = zip_open(docx_path.c_str(), ZIP_RDONLY, &err);
+    if (!zip_archive)
+    {
+        reportError(openError(err), "Failed to open DOCX file: " + docx_path);
+        return false;
+    }
+    zip_int64_t num_entries = zip_get_num_entries(zip_archive, 0);
+    zip_close(zip_archive);
+
+    // Create output directory if it doesn't exist
+    if (!create_directories(output_dir))
+    {
+        reportError(CONVERT_IO_ERROR, "Failed to create output directory: " + output_dir);
+        return false;
+    }
+
+    // Extract all files from the DOCX archive. Entries are independent, so
+    // chunks of them inflate on several cores.
+    parallelFor(static_cast<size_t>(std::max<zip_int64_t>(num_entries, 0)), 4, [&](size_t begin, size_t end) {
+        extractEntries(docx_path, output_dir, static_cast<zip_int64_t>(begin), static_cast<zip_int64_t>(end));
+    });
+    return true;
+}
+
+// Larger than any real part. Sizes come from the central directory and
+// decide the buffer a part is inflated into, so they are not trusted beyond it.
+static const zip_uint64_t MAX_PART_SIZE = 512ull * 1024 * 1024;
+
+struct DocxArchive::Prefetch
+{
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool done = false;
+    bool ok = false;
+    std::string data;
+};
+
+// Claimed one part at a time by the helper tasks of one prefetch() call
+struct DocxArchive::PrefetchBatch
+{
+    struct Job
+    {
+        zip_uint64_t index;
+        zip_uint64_t size;
+        std::shared_ptr<Prefetch> result;
+    };
+
+    std::string path;        // what the helpers open their handles on:
+    std::string_view buffer; // the file, or the caller's buffer if not empty
+    std::vector<Job> jobs;
+    std::atomic<size_t> next{0};
+    std::atomic<bool> cancelled{false}; // set by close(), unclaimed parts are dropped
+};
+
+// Decompresses entry index of archive into data, size is its uncompressed size
+static bool inflateEntry(zip *archive, zip_uint64_t index, zip_uint64_t size, std::string &data)
+{
+    zip_file *zf = zip_fopen_index(archive, index, 0);
+    if (!zf)
+    {
+        return false;
+    }
+
+    // The uncompressed size is known from the index, so decompress in a single read
+    data.resize(size);
+    zip_int64_t bytes_read = zip_fread(zf, &data[0], size);
+    zip_fclose(zf);
+    return bytes_read >= 0 && static_cast<zip_uint64_t>(bytes_read) == size;
+}
+
+// Another read-only handle on an archive, for a helper thread
+static zip *openHandle(const std::string &path, std::string_view buffer)
+{
+    if (buffer.empty())
+    {
+        int err;
+        return zip_open(path.c_str(), ZIP_RDONLY, &err);
+    }
+
+    // Sources only read the buffer, several can share it
+    zip_error_t error;
+    zip_error_init(&error);
+    zip *handle = nullptr;
+    zip_source_t *source = zip_source_buffer_create(buffer.data(), buffer.size(), 0, &error);
+    if (source)
+    {
+        handle = zip_open_from_source(source, ZIP_RDONLY, &error);
+        if (!handle)
+        {
+            zip_source_free(source);
+        }
+    }
+    zip_error_fini(&error);
+    return handle;
+}
+
+DocxArchive::~DocxArchive()
+{
+    close();
+}
+
+// Opens the DOCX and indexes its entries by name, nothing is decompressed yet
+bool DocxArchive::open(const std::string &docx_path)
+{
+    close();
+    StageTimer timer(STAGE_UNZIP);
+
+    int err;
+    archive_ = zip_open(docx_path.c_str(), ZIP_RDONLY, &err);
+    if (!archive_)
+    {
+        reportError(openError(err), "Failed to open DOCX file: " + docx_path);
+        return false;
+    }
+    path_ = docx_path;
+    return indexEntries();
+}
+
+bool DocxArchive::openFromBuffer(std::string_view data)
+{
+    close();
+    StageTimer timer(STAGE_UNZIP);
+
+    zip_error_t error;
+    zip_error_init(&error);
+    zip_source_t *source = zip_source_buffer_create(data.data(), data.size(), 0, &error);
+    if (source)
+    {
+        archive_ = zip_open_from_source(source, ZIP_RDONLY, &error);
+        if (!archive_)
+        {
+            zip_source_free(source);
+        }
+    }
+
+    if (!archive_)
+    {
+        reportError(CONVERT_INVALID_ARCHIVE, std::string("Failed to open DOCX from memory: ") + zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return false;
+    }
+    zip_error_fini(&error);
+
+    path_ = "<memory>";
+    buffer_ = data;
+    return indexEntries();
+}
+
+bool DocxArchive::indexEntries()
+{
+    // libzip has already read the central directory, so stat is just a lookup
+    zip_int64_t num_entries = zip_get_num_entries(archive_, 0);
+    entries_.reserve(num_entries);
+    for (zip_int64_t i = 0; i < num_entries; ++i)
+    {
+        zip_stat_t sb;
+        if (zip_stat_index(archive_, i, 0, &sb) != 0 || !sb.name)
+        {
+            reportWarning("Failed to stat entry " + std::to_string(i));
+            continue;
+        }
+
+        std::string name(sb.name);
+        if (name.empty() || name.back() == '/')
+        {
+            continue; // Directory entry
+        }
+
+        if (sb.size > MAX_PART_SIZE)
+        {
+            // A damaged or hostile archive, the part is treated as missing
+            reportWarning("Skipping " + name + ", it claims " + std::to_string(sb.size) + " bytes uncompressed");
+            continue;
+        }
+
+        Entry &entry = entries_[name];
+        entry.index = i;
+        entry.size = sb.size;
+    }
+
+    return true;
+}
+
+void DocxArchive::close()
+{
+    // Helpers may still be reading the file or the caller's buffer
+    for (const auto &batch : batches_)
+    {
+        batch->cancelled = true;
+    }
+    for (auto &entry : entries_)
+    {
+        if (entry.second.prefetch)
+        {
+            Prefetch &prefetch = *entry.second.prefetch;
+            std::unique_lock<std::mutex> lock(prefetch.mutex);
+            prefetch.ready.wait(lock, [&prefetch] { return prefetch.done; });
+        }
+    }
+    batches_.clear();
+    waiting_.clear();
+    nextWaiting_ = 0;
+    windowBytes_ = UINT64_MAX;
+    unreadBytes_ = 0;
+    window_ = 0;
+
+    if (archive_)
+    {
+        zip_close(archive_);
+        archive_ = nullptr;
+    }
+    entries_.clear();
+    path_.clear();
+    buffer_ = std::string_view();
+}
+
+bool DocxArchive::hasPart(const std::string &name) const
+{
+    return entries_.count(name) != 0;
+}
+
+size_t DocxArchive::partSize(const std::string &name) const
+{
+    auto it = entries_.find(name);
+    return it == entries_.end() ? 0 : it->second.size;
+}
+
+std::vector<std::string> DocxArchive::partNames(const std::string &prefix) const
+{
+    std::vector<std::string> names;
+    for (const auto &entry : entries_)
+    {
+        if (entry.first.compare(0, prefix.size(), prefix) == 0)
+        {
+            names.push_back(entry.first);
+        }
+    }
+    return names;
+}
+
+const std::string *DocxArchive::part(const std::string &name)
+{
+    auto it = entries_.find(name);
+    if (it == entries_.end())
+    {
+        return nullptr;
+    }
+
+    Entry &entry = it->second;
+    if (entry.data)
+    {
+        return entry.data.get();
+    }
+
+    std::unique_ptr<std::string> data(new std::string());
+    if (!readPart(name, *data))
+    {
+        return nullptr;
+    }
+    entry.data = std::move(data);
+    return entry.data.get();
+}
+
+bool DocxArchive::readPart(const std::string &name, std::string &data)
+{
+    auto it = entries_.find(name);
+    if (it == entries_.end())
+    {
+        return false;
+    }
+    Entry &entry = it->second;
+    if (entry.data)
+    {
+        data = *entry.data;
+        return true;
+    }
+
+    // A part read before its turn came is not prefetched any more
+    if (!entry.prefetch && nextWaiting_ < waiting_.size() && waiting_[nextWaiting_] == name)
+    {
+        nextWaiting_++;
+        issuePrefetches();
+    }
+
+    // A prefetched part is waited for, if its helper failed it is read here
+    StageTimer timer(STAGE_UNZIP);
+    if (!(entry.prefetch && takePrefetched(entry, data)) && !inflateEntry(archive_, entry.index, entry.size, data))
+    {
+        reportError(CONVERT_INVALID_ARCHIVE, "Error reading from ZIP file: " + name);
+        return false;
+    }
+
+    countMetric(COUNTER_BYTES_DECOMPRESSED, entry.size);
     return true;
 }
+
+bool DocxArchive::takePrefetched(Entry &entry, std::string &data)
+{
+    std::shared_ptr<Prefetch> prefetch = std::move(entry.prefetch);
+    if (entry.window == window_)
+    {
+        unreadBytes_ -= entry.size;
+        issuePrefetches(); // room for the next waiting parts
+    }
+
+    std::unique_lock<std::mutex> lock(prefetch->mutex);
+    prefetch->ready.wait(lock, [&prefetch] { return prefetch->done; });
+    if (!prefetch->ok)
+    {
+        return false;
+    }
+    data = std::move(prefetch->data);
+    return true;
+}
+
+void DocxArchive::prefetch(const std::vector<std::string> &names, uint64_t windowBytes)
+{
+    if (!helperPool() || !archive_)
+    {
+        return;
+    }
+    waiting_ = names;
+    nextWaiting_ = 0;
+    windowBytes_ = windowBytes;
+    unreadBytes_ = 0; // parts of earlier calls don't count against this window
+    window_++;
+    issuePrefetches();
+}
+
+void DocxArchive::issuePrefetches()
+{
+    ThreadPool *helpers = helperPool();
+    if (!helpers || nextWaiting_ >= waiting_.size())
+    {
+        return;
+    }
+
+    auto batch = std::make_shared<PrefetchBatch>();
+    batch->path = path_;
+    batch->buffer = buffer_;
+    for (; nextWaiting_ < waiting_.size(); ++nextWaiting_)
+    {
+        auto it = entries_.find(waiting_[nextWaiting_]);
+        if (it == entries_.end() || it->second.data || it->second.prefetch)
+        {
+            continue;
+        }
+        // Parts go out in order; one always does if nothing is unread
+        Entry &entry = it->second;
+        if (unreadBytes_ > 0 && entry.size > windowBytes_ - std::min(windowBytes_, unreadBytes_))
+        {
+            break;
+        }
+        unreadBytes_ += entry.size;
+        entry.window = window_;
+        entry.prefetch = std::make_shared<Prefetch>();
+        batch->jobs.push_back(PrefetchBatch::Job{entry.index, entry.size, entry.prefetch});
+    }
+    if (nextWaiting_ >= waiting_.size())
+    {
+        waiting_.clear();
+        nextWaiting_ = 0;
+    }
+    if (batch->jobs.empty())
+    {
+        return;
+    }
+
+    // Batches whose parts have all been claimed need no cancelling any more
+    batches_.erase(std::remove_if(batches_.begin(), batches_.end(),
+                                  [](const std::shared_ptr<PrefetchBatch> &old) { return old->next >= old->jobs.size(); }),
+                   batches_.end());
+
+    size_t tasks = std::min(helpers->size(), batch->jobs.size());
+    for (size_t i = 0; i < tasks; ++i)
+    {
+        helpers->submit([batch]() { runPrefetch(*batch); });
+    }
+    batches_.push_back(batch);
+}
+
+// One helper's share of a batch: a handle of its own, then parts until none are left
+void DocxArchive::runPrefetch(PrefetchBatch &batch)
+{
+    // The handle is opened once a part is claimed. close() waits for claimed
+    // parts only, a task that comes too late must not touch the buffer.
+    zip *handle = nullptr;
+    bool opened = false;
+    for (size_t i; (i = batch.next++) < batch.jobs.size();)
+    {
+        PrefetchBatch::Job &job = batch.jobs[i];
+        Prefetch &result = *job.result;
+        if (!opened && !batch.cancelled)
+        {
+            handle = openHandle(batch.path, batch.buffer);
+            opened = true;
+        }
+        // Whatever happens the part is marked done, the owner waits for that
+        bool ok = false;
+        try
+        {
+            ok = handle && !batch.cancelled && inflateEntry(handle, job.index, job.size, result.data);
+        }
+        catch (const std::exception &)
+        {
+            // bad_alloc for a part too large to hold, the owner reads it itself
+        }
+        if (!ok)
+        {
+            std::string().swap(result.data);
+        }
+
+        std::lock_guard<std::mutex> lock(result.mutex);
+        result.ok = ok;
+        result.done = true;
+        result.ready.notify_all();
+    }
+    if (handle)
+    {
+        zip_close(handle);
+    }
+}
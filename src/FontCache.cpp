@@ -0,0 +1,84 @@
+#include "FontCache.h"
+#include "Diagnostics.h"
+#include "Hash.h"
+#include <sys/stat.h>
+#include <cstdlib>
+#include <memory>
+
+static const char *fontFiles[FONT_COUNT] = {"DejaVuSans.ttf", "DejaVuSans-Bold.ttf",
+                                            "DejaVuSans-Oblique.ttf", "DejaVuSans-BoldOblique.ttf"};
+
+static bool hasFonts(const std::string &dir)
+{
+    struct stat info;
+    return stat((dir + fontFiles[FONT_REGULAR]).c_str(), &info) == 0;
+}
+
+const std::string &fontDirectory()
+{
+    static const std::string directory = []() {
+        const char *env = getenv("DOCX2PDF_FONT_DIR");
+        if (env && *env)
+        {
+            std::string dir(env);
+            if (dir.back() != '/')
+                dir += '/';
+            return dir;
+        }
+
+        const char *candidates[] = {
+            "../fonts/dejavu-fonts-ttf/ttf/",
+            "fonts/dejavu-fonts-ttf/ttf/",
+#ifdef DOCX2PDF_SOURCE_FONT_DIR
+            DOCX2PDF_SOURCE_FONT_DIR,
+#endif
+        };
+        for (const char *candidate : candidates)
+        {
+            if (hasFonts(candidate))
+                return std::string(candidate);
+        }
+
+        // Keep the historical default so the error message points somewhere sensible
+        return std::string(candidates[0]);
+    }();
+    return directory;
+}
+
+std::string fontFilePath(FontId id)
+{
+    return fontDirectory() + fontFiles[id];
+}
+
+const FontCache *FontCache::instance()
+{
+    // Function-local static: loaded exactly once even with concurrent first calls
+    static const std::unique_ptr<FontCache> cache = []() {
+        std::unique_ptr<FontCache> loaded(new FontCache);
+        if (!loaded->load())
+            loaded.reset();
+        return loaded;
+    }();
+    return cache.get();
+}
+
+bool FontCache::load()
+{
+    for (int id = 0; id < FONT_COUNT; ++id)
+    {
+        std::string path = fontFilePath(static_cast<FontId>(id));
+        if (!files_[id].open(path))
+        {
+            reportError(CONVERT_FONTS_UNAVAILABLE, "Failed to load TrueType font " + path);
+            return false;
+        }
+        if (!metrics_[id].load(files_[id].view()))
+        {
+            reportError(CONVERT_FONTS_UNAVAILABLE, "Failed to read metrics from font file: " + path);
+            return false;
+        }
+        Hash128 hash = hash128(files_[id].view(), fingerprint_);
+        fingerprint_ = hash.low ^ hash.high;
+    }
+    return true;
+}
@@ -0,0 +1,370 @@
+#include "FontMetrics.h"
+#include "Diagnostics.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// TrueType data is big-endian
+static uint16_t readU16(const unsigned char *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t readU32(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+uint32_t decodeUtf8(std::string_view text, size_t &pos)
+{
+    unsigned char c = static_cast<unsigned char>(text[pos++]);
+    if (c < 0x80)
+        return c;
+
+    int extra;
+    uint32_t cp;
+    if ((c & 0xE0) == 0xC0)
+    {
+        extra = 1;
+        cp = c & 0x1F;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+        extra = 2;
+        cp = c & 0x0F;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+        extra = 3;
+        cp = c & 0x07;
+    }
+    else
+    {
+        return 0xFFFD;
+    }
+
+    if (pos + extra > text.size())
+        return 0xFFFD;
+    for (int i = 0; i < extra; ++i)
+    {
+        unsigned char next = static_cast<unsigned char>(text[pos + i]);
+        if ((next & 0xC0) != 0x80)
+            return 0xFFFD;
+        cp = (cp << 6) | (next & 0x3F);
+    }
+    pos += extra;
+    return cp;
+}
+
+bool FontMetrics::loadFromFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+    {
+        reportError(CONVERT_FONTS_UNAVAILABLE, "Failed to open font file: " + path);
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    owned_ = buffer.str();
+
+    if (!load(owned_))
+    {
+        reportError(CONVERT_FONTS_UNAVAILABLE, "Failed to read metrics from font file: " + path);
+        return false;
+    }
+    return true;
+}
+
+bool FontMetrics::load(std::string_view data)
+{
+    data_ = data;
+    return parse();
+}
+
+bool FontMetrics::parse()
+{
+    const unsigned char *font = reinterpret_cast<const unsigned char *>(data_.data());
+    size_t size = data_.size();
+    if (size < 12)
+        return false;
+
+    // Table directory
+    const unsigned char *head = nullptr, *hhea = nullptr, *maxp = nullptr, *hmtx = nullptr, *cmap = nullptr;
+    size_t hmtxLength = 0, cmapLength = 0;
+
+    uint16_t numTables = readU16(font + 4);
+    if (12 + numTables * 16u > size)
+        return false;
+
+    for (uint16_t i = 0; i < numTables; ++i)
+    {
+        const unsigned char *record = font + 12 + i * 16;
+        uint32_t offset = readU32(record + 8);
+        uint32_t length = readU32(record + 12);
+        if (offset > size || length > size - offset)
+            return false;
+
+        const unsigned char *table = font + offset;
+        if (memcmp(record, "head", 4) == 0 && length >= 54)
+            head = table;
+        else if (memcmp(record, "hhea", 4) == 0 && length >= 36)
+            hhea = table;
+        else if (memcmp(record, "maxp", 4) == 0 && length >= 6)
+            maxp = table;
+        else if (memcmp(record, "hmtx", 4) == 0)
+        {
+            hmtx = table;
+            hmtxLength = length;
+        }
+        else if (memcmp(record, "cmap", 4) == 0)
+        {
+            cmap = table;
+            cmapLength = length;
+        }
+    }
+
+    if (!head || !hhea || !maxp || !hmtx || !cmap)
+        return false;
+
+    uint16_t unitsPerEm = readU16(head + 18);
+    uint16_t numGlyphs = readU16(maxp + 4);
+    uint16_t numHMetrics = readU16(hhea + 34);
+    if (unitsPerEm == 0 || numHMetrics == 0 || numHMetrics * 4u > hmtxLength)
+        return false;
+
+    // Glyphs past numberOfHMetrics repeat the last advance width
+    glyphWidths_.assign(numGlyphs, 0);
+    uint16_t advance = 0;
+    for (uint16_t gid = 0; gid < numGlyphs; ++gid)
+    {
+        if (gid < numHMetrics)
+            advance = readU16(hmtx + gid * 4);
+        glyphWidths_[gid] = static_cast<uint16_t>(static_cast<uint32_t>(advance) * 1000 / unitsPerEm);
+    }
+
+    bmpGlyphs_.assign(0x10000, 0);
+    groups_.clear();
+    if (!parseCmap(cmap, cmapLength))
+        return false;
+
+    bmpWidths_.resize(0x10000);
+    for (uint32_t cp = 0; cp < 0x10000; ++cp)
+    {
+        bmpWidths_[cp] = static_cast<uint16_t>(glyphWidth(bmpGlyphs_[cp]));
+    }
+    return true;
+}
+
+bool FontMetrics::parseCmap(const unsigned char *table, size_t length)
+{
+    if (length < 4)
+        return false;
+
+    // Prefer the Windows Unicode BMP subtable (what libharu uses), plus the
+    // full-repertoire one for anything above U+FFFF
+    const unsigned char *bmp = nullptr, *full = nullptr;
+    uint16_t numSubtables = readU16(table + 2);
+    for (uint16_t i = 0; i < numSubtables && 4 + (i + 1) * 8u <= length; ++i)
+    {
+        const unsigned char *record = table + 4 + i * 8;
+        uint16_t platform = readU16(record);
+        uint16_t encoding = readU16(record + 2);
+        uint32_t offset = readU32(record + 4);
+        if (offset + 8 > length)
+            continue;
+
+        const unsigned char *sub = table + offset;
+        uint16_t format = readU16(sub);
+        if (format == 4 && ((platform == 3 && encoding == 1) || (platform == 0 && !bmp)))
+            bmp = sub;
+        else if (format == 12 && ((platform == 3 && encoding == 10) || platform == 0))
+            full = sub;
+    }
+
+    if (!bmp)
+        return false;
+
+    const unsigned char *end = table + length;
+    uint16_t segCount = readU16(bmp + 6) / 2;
+    const unsigned char *endCodes = bmp + 14;
+    const unsigned char *startCodes = endCodes + segCount * 2 + 2;
+    const unsigned char *idDeltas = startCodes + segCount * 2;
+    const unsigned char *idRangeOffsets = idDeltas + segCount * 2;
+    if (idRangeOffsets + segCount * 2 > end)
+        return false;
+
+    for (uint16_t seg = 0; seg < segCount; ++seg)
+    {
+        uint16_t endCode = readU16(endCodes + seg * 2);
+        uint16_t startCode = readU16(startCodes + seg * 2);
+        uint16_t idDelta = readU16(idDeltas + seg * 2);
+        uint16_t idRangeOffset = readU16(idRangeOffsets + seg * 2);
+
+        for (uint32_t cp = startCode; cp <= endCode && cp != 0xFFFF; ++cp)
+        {
+            uint16_t glyph;
+            if (idRangeOffset == 0)
+            {
+                glyph = static_cast<uint16_t>(cp + idDelta);
+            }
+            else
+            {
+                const unsigned char *p = idRangeOffsets + seg * 2 + idRangeOffset + (cp - startCode) * 2;
+                if (p + 2 > end)
+                    break;
+                glyph = readU16(p);
+                if (glyph != 0)
+                    glyph = static_cast<uint16_t>(glyph + idDelta);
+            }
+            bmpGlyphs_[cp] = glyph < glyphWidths_.size() ? glyph : 0;
+        }
+    }
+
+    if (full && full + 16 <= end)
+    {
+        uint32_t numGroups = readU32(full + 12);
+        for (uint32_t i = 0; i < numGroups && full + 16 + (i + 1) * 12 <= end; ++i)
+        {
+            const unsigned char *group = full + 16 + i * 12;
+            CmapGroup g = {readU32(group), readU32(group + 4), readU32(group + 8)};
+            if (g.lastChar >= 0x10000 && g.firstChar <= g.lastChar)
+            {
+                g.firstChar = std::max<uint32_t>(g.firstChar, 0x10000);
+                groups_.push_back(g);
+            }
+        }
+    }
+    return true;
+}
+
+uint16_t FontMetrics::glyphIndex(uint32_t codepoint) const
+{
+    if (codepoint < 0x10000)
+        return bmpGlyphs_[codepoint];
+
+    // Groups are sorted by first character
+    auto it = std::upper_bound(groups_.begin(), groups_.end(), codepoint,
+                               [](uint32_t cp, const CmapGroup &g) { return cp < g.firstChar; });
+    if (it == groups_.begin())
+        return 0;
+    --it;
+    if (codepoint > it->lastChar)
+        return 0;
+
+    uint32_t glyph = it->firstGlyph + (codepoint - it->firstChar);
+    return glyph < glyphWidths_.size() ? static_cast<uint16_t>(glyph) : 0;
+}
+
+int FontMetrics::glyphWidth(uint16_t glyph) const
+{
+    // Unmapped codepoints render as .notdef (glyph 0)
+    return glyph < glyphWidths_.size() ? glyphWidths_[glyph] : (glyphWidths_.empty() ? 0 : glyphWidths_[0]);
+}
+
+// FNV-1a, words are short so this beats anything fancier
+static uint64_t hashWord(std::string_view word)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (char c : word)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool TextMeasurer::WordWidthMemo::find(std::string_view word, uint64_t hash, int &units) const
+{
+    if (slots_.empty())
+        return false;
+
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        const Slot &slot = slots_[i];
+        if (slot.units < 0)
+            return false;
+        if (slot.hash == hash && slot.length == word.size() &&
+            memcmp(pool_.data() + slot.offset, word.data(), word.size()) == 0)
+        {
+            units = slot.units;
+            return true;
+        }
+    }
+}
+
+void TextMeasurer::WordWidthMemo::insert(std::string_view word, uint64_t hash, int units)
+{
+    // Keep the memo bounded on huge documents, it only ever trades memory for speed
+    if (pool_.size() + word.size() > (16u << 20))
+    {
+        slots_.clear();
+        pool_.clear();
+        used_ = 0;
+    }
+    if ((used_ + 1) * 2 > slots_.size())
+        grow();
+
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i].units >= 0)
+        i = (i + 1) & mask;
+
+    slots_[i].hash = hash;
+    slots_[i].offset = static_cast<uint32_t>(pool_.size());
+    slots_[i].length = static_cast<uint32_t>(word.size());
+    slots_[i].units = units;
+    pool_.append(word.data(), word.size());
+    used_++;
+}
+
+void TextMeasurer::WordWidthMemo::grow()
+{
+    std::vector<Slot> old;
+    old.swap(slots_);
+    slots_.resize(old.empty() ? 1024 : old.size() * 2);
+
+    size_t mask = slots_.size() - 1;
+    for (const Slot &slot : old)
+    {
+        if (slot.units < 0)
+            continue;
+        size_t i = slot.hash & mask;
+        while (slots_[i].units >= 0)
+            i = (i + 1) & mask;
+        slots_[i] = slot;
+    }
+}
+
+int TextMeasurer::measureUnits(FontId font, std::string_view text)
+{
+    const FontMetrics *metrics = fonts_[font];
+    if (!metrics)
+        return 0;
+    tokensMeasured_++;
+
+    // Single characters and spaces are cheaper to sum than to hash
+    if (text.size() <= 2)
+    {
+        int units = 0;
+        for (size_t pos = 0; pos < text.size();)
+            units += metrics->charWidth(decodeUtf8(text, pos));
+        return units;
+    }
+
+    uint64_t hash = hashWord(text);
+    int units;
+    if (memo_[font].find(text, hash, units))
+        return units;
+
+    units = 0;
+    for (size_t pos = 0; pos < text.size();)
+        units += metrics->charWidth(decodeUtf8(text, pos));
+
+    memo_[font].insert(text, hash, units);
+    return units;
+}
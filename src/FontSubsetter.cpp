@@ -0,0 +1,229 @@
+#include "FontSubsetter.h"
+#include <algorithm>
+#include <cstring>
+
+// TrueType data is big-endian
+static uint16_t readU16(const unsigned char *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t readU32(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static void writeU16(std::string &out, size_t pos, uint16_t value)
+{
+    out[pos] = static_cast<char>(value >> 8);
+    out[pos + 1] = static_cast<char>(value);
+}
+
+static void writeU32(std::string &out, size_t pos, uint32_t value)
+{
+    out[pos] = static_cast<char>(value >> 24);
+    out[pos + 1] = static_cast<char>(value >> 16);
+    out[pos + 2] = static_cast<char>(value >> 8);
+    out[pos + 3] = static_cast<char>(value);
+}
+
+// Table checksum: sum of big-endian uint32s, the data is zero padded to 4 bytes
+static uint32_t tableChecksum(const std::string &data, size_t offset, size_t length)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data.data()) + offset;
+    uint32_t sum = 0;
+    size_t words = (length + 3) / 4;
+    for (size_t i = 0; i < words; ++i)
+        sum += readU32(p + i * 4);
+    return sum;
+}
+
+namespace
+{
+struct TableRecord
+{
+    char tag[4];
+    uint32_t offset;
+    uint32_t length;
+    std::string replacement; // rebuilt contents when replaced is set
+    bool replaced = false;
+};
+
+// Component flags of composite glyphs
+constexpr uint16_t ARG_1_AND_2_ARE_WORDS = 0x0001;
+constexpr uint16_t WE_HAVE_A_SCALE = 0x0008;
+constexpr uint16_t MORE_COMPONENTS = 0x0020;
+constexpr uint16_t WE_HAVE_AN_X_AND_Y_SCALE = 0x0040;
+constexpr uint16_t WE_HAVE_A_TWO_BY_TWO = 0x0080;
+} // namespace
+
+std::string subsetTrueTypeFont(std::string_view font, const std::vector<uint8_t> &usedGlyphs)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(font.data());
+    size_t size = font.size();
+    if (size < 12)
+        return std::string();
+
+    uint16_t numTables = readU16(data + 4);
+    if (12 + numTables * 16u > size)
+        return std::string();
+
+    std::vector<TableRecord> tables(numTables);
+    TableRecord *head = nullptr, *maxp = nullptr, *loca = nullptr, *glyf = nullptr;
+    for (uint16_t i = 0; i < numTables; ++i)
+    {
+        const unsigned char *record = data + 12 + i * 16;
+        TableRecord &table = tables[i];
+        memcpy(table.tag, record, 4);
+        table.offset = readU32(record + 8);
+        table.length = readU32(record + 12);
+        if (table.offset > size || table.length > size - table.offset)
+            return std::string();
+
+        if (memcmp(table.tag, "head", 4) == 0 && table.length >= 54)
+            head = &table;
+        else if (memcmp(table.tag, "maxp", 4) == 0 && table.length >= 6)
+            maxp = &table;
+        else if (memcmp(table.tag, "loca", 4) == 0)
+            loca = &table;
+        else if (memcmp(table.tag, "glyf", 4) == 0)
+            glyf = &table;
+    }
+
+    if (!head || !maxp || !loca || !glyf)
+        return std::string();
+
+    bool longOffsets = readU16(data + head->offset + 50) != 0;
+    uint16_t numGlyphs = readU16(data + maxp->offset + 4);
+    if (loca->length < (numGlyphs + 1u) * (longOffsets ? 4u : 2u))
+        return std::string();
+
+    // Original glyph locations, relative to the start of glyf
+    std::vector<uint32_t> offsets(numGlyphs + 1);
+    const unsigned char *locaData = data + loca->offset;
+    for (uint32_t gid = 0; gid <= numGlyphs; ++gid)
+    {
+        offsets[gid] = longOffsets ? readU32(locaData + gid * 4) : readU16(locaData + gid * 2) * 2u;
+        if (offsets[gid] > glyf->length || (gid > 0 && offsets[gid] < offsets[gid - 1]))
+            return std::string();
+    }
+
+    // Glyphs to keep: the used ones, .notdef, and everything composites refer to
+    std::vector<uint8_t> keep(numGlyphs, 0);
+    std::vector<uint16_t> pending;
+    auto mark = [&](uint32_t gid) {
+        if (gid < numGlyphs && !keep[gid])
+        {
+            keep[gid] = 1;
+            pending.push_back(static_cast<uint16_t>(gid));
+        }
+    };
+
+    mark(0);
+    for (size_t gid = 0; gid < usedGlyphs.size() && gid < numGlyphs; ++gid)
+    {
+        if (usedGlyphs[gid])
+            mark(static_cast<uint32_t>(gid));
+    }
+
+    const unsigned char *glyfData = data + glyf->offset;
+    while (!pending.empty())
+    {
+        uint16_t gid = pending.back();
+        pending.pop_back();
+
+        uint32_t start = offsets[gid], end = offsets[gid + 1];
+        if (end - start < 10 || static_cast<int16_t>(readU16(glyfData + start)) >= 0)
+            continue; // empty or simple glyph
+
+        uint32_t pos = start + 10; // past the glyph header
+        uint16_t flags = 0;
+        do
+        {
+            if (pos + 4 > end)
+                break;
+            flags = readU16(glyfData + pos);
+            mark(readU16(glyfData + pos + 2));
+
+            pos += 4 + ((flags & ARG_1_AND_2_ARE_WORDS) ? 4 : 2);
+            if (flags & WE_HAVE_A_SCALE)
+                pos += 2;
+            else if (flags & WE_HAVE_AN_X_AND_Y_SCALE)
+                pos += 4;
+            else if (flags & WE_HAVE_A_TWO_BY_TWO)
+                pos += 8;
+        } while (flags & MORE_COMPONENTS);
+    }
+
+    // New glyf with the kept outlines in their original slots, each padded to
+    // 4 bytes, and the matching loca
+    std::string &newGlyf = glyf->replacement;
+    std::vector<uint32_t> newOffsets(numGlyphs + 1);
+    for (uint32_t gid = 0; gid < numGlyphs; ++gid)
+    {
+        newOffsets[gid] = static_cast<uint32_t>(newGlyf.size());
+        if (keep[gid])
+        {
+            newGlyf.append(font.data() + glyf->offset + offsets[gid], offsets[gid + 1] - offsets[gid]);
+            newGlyf.resize((newGlyf.size() + 3) & ~size_t(3), '\0');
+        }
+    }
+    newOffsets[numGlyphs] = static_cast<uint32_t>(newGlyf.size());
+    glyf->replaced = true;
+
+    // Short offsets store half the byte offset in 16 bits
+    if (!longOffsets && newGlyf.size() / 2 > 0xFFFF)
+        longOffsets = true;
+
+    std::string &newLoca = loca->replacement;
+    newLoca.resize((numGlyphs + 1) * (longOffsets ? 4 : 2));
+    for (uint32_t gid = 0; gid <= numGlyphs; ++gid)
+    {
+        if (longOffsets)
+            writeU32(newLoca, gid * 4, newOffsets[gid]);
+        else
+            writeU16(newLoca, gid * 2, static_cast<uint16_t>(newOffsets[gid] / 2));
+    }
+    loca->replaced = true;
+
+    // head is copied with checkSumAdjustment cleared, fixed up once the file is done
+    std::string &newHead = head->replacement;
+    newHead.assign(font.data() + head->offset, head->length);
+    writeU32(newHead, 8, 0);
+    writeU16(newHead, 50, longOffsets ? 1 : 0);
+    head->replaced = true;
+
+    // Assemble the file: same header and table order, every table 4-byte aligned
+    std::string out(font.data(), 12 + numTables * 16u);
+    size_t headOffset = 0;
+    for (uint16_t i = 0; i < numTables; ++i)
+    {
+        TableRecord &table = tables[i];
+        size_t offset = out.size();
+        size_t length;
+        if (table.replaced)
+        {
+            out.append(table.replacement);
+            length = table.replacement.size();
+        }
+        else
+        {
+            out.append(font.data() + table.offset, table.length);
+            length = table.length;
+        }
+        out.resize((out.size() + 3) & ~size_t(3), '\0');
+
+        if (&table == head)
+            headOffset = offset;
+
+        size_t record = 12 + i * 16u;
+        writeU32(out, record + 4, tableChecksum(out, offset, length));
+        writeU32(out, record + 8, static_cast<uint32_t>(offset));
+        writeU32(out, record + 12, static_cast<uint32_t>(length));
+    }
+
+    uint32_t fileSum = tableChecksum(out, 0, out.size());
+    writeU32(out, headOffset + 8, 0xB1B0AFBAu - fileSum);
+    return out;
+}
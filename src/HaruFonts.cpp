@@ -0,0 +1,82 @@
+#include "HaruFonts.h"
+#include <hpdf_doc.h>
+#include <hpdf_fontdef.h>
+#include <hpdf_streams.h>
+#include <cstring>
+
+// Mirrors LoadTTFontFromStream() in libharu's hpdf.c, with a memory stream
+// standing in for the file reader
+const char *loadTTFontFromMemory(HPDF_Doc pdf, std::string_view fontData, bool embedding)
+{
+    if (fontData.empty())
+    {
+        return nullptr;
+    }
+
+    HPDF_Stream stream = HPDF_MemStream_New(pdf->mmgr, static_cast<HPDF_UINT>(fontData.size()));
+    if (!stream)
+    {
+        return nullptr;
+    }
+
+    if (HPDF_Stream_Write(stream, reinterpret_cast<const HPDF_BYTE *>(fontData.data()),
+                          static_cast<HPDF_UINT>(fontData.size())) != HPDF_OK ||
+        HPDF_Stream_Seek(stream, 0, HPDF_SEEK_SET) != HPDF_OK)
+    {
+        HPDF_Stream_Free(stream);
+        return nullptr;
+    }
+
+    // The font definition takes ownership of the stream, it is read again
+    // when the embedded font program is written out
+    HPDF_FontDef def = HPDF_TTFontDef_Load(pdf->mmgr, stream, embedding ? HPDF_TRUE : HPDF_FALSE);
+    if (!def)
+    {
+        return nullptr;
+    }
+
+    // libharu only embeds outlines of glyphs that went through HPDF_Page_ShowText.
+    // The emitter writes its own content streams and the data is subset already,
+    // glyphs nothing draws are empty, so every glyph is marked as used.
+    if (embedding)
+    {
+        HPDF_TTFontDefAttr attr = static_cast<HPDF_TTFontDefAttr>(def->attr);
+        memset(attr->glyph_tbl.flgs, 1, attr->num_glyphs);
+    }
+
+    if (HPDF_Doc_FindFontDef(pdf, def->base_font))
+    {
+        HPDF_FontDef_Free(def);
+        return nullptr;
+    }
+
+    if (HPDF_List_Add(pdf->fontdef_list, def) != HPDF_OK)
+    {
+        HPDF_FontDef_Free(def);
+        return nullptr;
+    }
+
+    // Embedded fonts get a unique subset tag per document (HPDFAA, HPDFAB, ...)
+    if (embedding)
+    {
+        if (pdf->ttfont_tag[0] == 0)
+        {
+            memcpy(pdf->ttfont_tag, "HPDFAA", 6);
+        }
+        else
+        {
+            for (int i = 5; i >= 0; i--)
+            {
+                pdf->ttfont_tag[i] += 1;
+                if (pdf->ttfont_tag[i] > 'Z')
+                    pdf->ttfont_tag[i] = 'A';
+                else
+                    break;
+            }
+        }
+
+        HPDF_TTFontDef_SetTagName(def, reinterpret_cast<char *>(pdf->ttfont_tag));
+    }
+
+    return def->base_font;
+}
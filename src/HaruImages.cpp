@@ -0,0 +1,144 @@
+#include "HaruImages.h"
+#include "HaruPages.h"
+#include "Images.h"
+#include <hpdf_doc.h>
+#include <hpdf_objects.h>
+#include <hpdf_streams.h>
+
+// An empty image XObject, what HPDF_Image_LoadJpegImage() in libharu's
+// hpdf_image.c starts from
+static HPDF_Image newImage(HPDF_Doc pdf, uint32_t width, uint32_t height, int bitsPerComponent)
+{
+    HPDF_Dict image = HPDF_DictStream_New(pdf->mmgr, pdf->xref);
+    if (!image)
+    {
+        return nullptr;
+    }
+    image->header.obj_class |= HPDF_OSUBCLASS_XOBJECT;
+
+    HPDF_STATUS ret = HPDF_Dict_AddName(image, "Type", "XObject");
+    ret += HPDF_Dict_AddName(image, "Subtype", "Image");
+    ret += HPDF_Dict_AddNumber(image, "Width", static_cast<HPDF_INT32>(width));
+    ret += HPDF_Dict_AddNumber(image, "Height", static_cast<HPDF_INT32>(height));
+    ret += HPDF_Dict_AddNumber(image, "BitsPerComponent", bitsPerComponent);
+    return ret == HPDF_OK ? image : nullptr;
+}
+
+static HPDF_Image loadJpeg(HPDF_Doc pdf, std::string_view data, const JpegInfo &info)
+{
+    HPDF_Image image = newImage(pdf, info.width, info.height, info.bitsPerComponent);
+    if (!image)
+    {
+        return nullptr;
+    }
+
+    HPDF_STATUS ret = HPDF_OK;
+    if (info.components == 1)
+    {
+        ret += HPDF_Dict_AddName(image, "ColorSpace", "DeviceGray");
+    }
+    else if (info.components == 3)
+    {
+        ret += HPDF_Dict_AddName(image, "ColorSpace", "DeviceRGB");
+    }
+    else
+    {
+        ret += HPDF_Dict_AddName(image, "ColorSpace", "DeviceCMYK");
+        if (info.adobe)
+        {
+            // Adobe applications write CMYK JPEGs inverted
+            HPDF_Array decode = HPDF_Array_New(pdf->mmgr);
+            if (!decode)
+            {
+                return nullptr;
+            }
+            ret += HPDF_Dict_Add(image, "Decode", decode);
+            for (int i = 0; i < 4; ++i)
+            {
+                ret += HPDF_Array_AddNumber(decode, 1);
+                ret += HPDF_Array_AddNumber(decode, 0);
+            }
+        }
+    }
+
+    // Only FlateDecode makes libharu compress a stream on output, DCT data is written out unchanged
+    image->filter = HPDF_STREAM_FILTER_DCT_DECODE;
+    ret += HPDF_Stream_Write(image->stream, reinterpret_cast<const HPDF_BYTE *>(data.data()),
+                             static_cast<HPDF_UINT>(data.size()));
+    return ret == HPDF_OK ? image : nullptr;
+}
+
+static HPDF_Image loadPng(HPDF_Doc pdf, const PngInfo &info)
+{
+    HPDF_Image image = newImage(pdf, info.width, info.height, info.bitDepth);
+    if (!image)
+    {
+        return nullptr;
+    }
+
+    HPDF_STATUS ret = HPDF_OK;
+    if (info.colorType == 3)
+    {
+        // [/Indexed /DeviceRGB hival <palette>]
+        HPDF_Array colorSpace = HPDF_Array_New(pdf->mmgr);
+        HPDF_Binary palette = HPDF_Binary_New(pdf->mmgr, const_cast<HPDF_BYTE *>(
+                                                             reinterpret_cast<const HPDF_BYTE *>(info.palette.data())),
+                                              static_cast<HPDF_UINT>(info.palette.size()));
+        if (!colorSpace || !palette)
+        {
+            return nullptr;
+        }
+        ret += HPDF_Dict_Add(image, "ColorSpace", colorSpace);
+        ret += HPDF_Array_AddName(colorSpace, "Indexed");
+        ret += HPDF_Array_AddName(colorSpace, "DeviceRGB");
+        ret += HPDF_Array_AddNumber(colorSpace, static_cast<HPDF_INT32>(info.palette.size() / 3 - 1));
+        ret += HPDF_Array_Add(colorSpace, palette);
+    }
+    else
+    {
+        ret += HPDF_Dict_AddName(image, "ColorSpace", info.colorType == 2 ? "DeviceRGB" : "DeviceGray");
+    }
+
+    // Predictor 15: every row starts with its PNG filter type byte
+    HPDF_Dict parms = HPDF_Dict_New(pdf->mmgr);
+    if (!parms)
+    {
+        return nullptr;
+    }
+    ret += HPDF_Dict_Add(image, "DecodeParms", parms);
+    ret += HPDF_Dict_AddNumber(parms, "Predictor", 15);
+    ret += HPDF_Dict_AddNumber(parms, "Colors", info.colors());
+    ret += HPDF_Dict_AddNumber(parms, "BitsPerComponent", info.bitDepth);
+    ret += HPDF_Dict_AddNumber(parms, "Columns", static_cast<HPDF_INT32>(info.width));
+
+    // The IDAT payloads together are one zlib stream
+    markDeflated(image);
+    for (std::string_view chunk : info.idat)
+    {
+        ret += HPDF_Stream_Write(image->stream, reinterpret_cast<const HPDF_BYTE *>(chunk.data()),
+                                 static_cast<HPDF_UINT>(chunk.size()));
+    }
+    return ret == HPDF_OK ? image : nullptr;
+}
+
+HPDF_Image loadImageFromMemory(HPDF_Doc pdf, std::string_view data)
+{
+    JpegInfo jpeg;
+    if (readJpegInfo(data, jpeg))
+    {
+        // Nothing here decodes JPEG, a frame DCTDecode can't read is left out
+        return jpeg.passThrough() ? loadJpeg(pdf, data, jpeg) : nullptr;
+    }
+
+    PngInfo png;
+    if (!readPngInfo(data, png))
+    {
+        return nullptr;
+    }
+    if (png.passThrough())
+    {
+        return loadPng(pdf, png);
+    }
+    return HPDF_LoadPngImageFromMem(pdf, reinterpret_cast<const HPDF_BYTE *>(data.data()),
+                                    static_cast<HPDF_UINT>(data.size()));
+}
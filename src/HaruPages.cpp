@@ -0,0 +1,35 @@
+#include "HaruPages.h"
+#include <hpdf_objects.h>
+#include <hpdf_pages.h>
+#include <hpdf_streams.h>
+
+// Written after the dictionary's other entries
+static HPDF_STATUS writeFlateFilter(HPDF_Dict dict, HPDF_Stream stream)
+{
+    (void)dict;
+    return HPDF_Stream_WriteStr(stream, "/Filter /FlateDecode\012");
+}
+
+void markDeflated(HPDF_Dict stream)
+{
+    stream->filter = HPDF_STREAM_FILTER_NONE;
+    stream->write_fn = writeFlateFilter;
+}
+
+const char *pageFontName(HPDF_Page page, HPDF_Font font)
+{
+    return HPDF_Page_GetLocalFontName(page, font);
+}
+
+const char *pageImageName(HPDF_Page page, HPDF_Image image)
+{
+    return HPDF_Page_GetXObjectName(page, image);
+}
+
+bool setPageContents(HPDF_Page page, std::string_view deflated)
+{
+    HPDF_PageAttr attr = static_cast<HPDF_PageAttr>(page->attr);
+    markDeflated(attr->contents);
+    return HPDF_Stream_Write(attr->stream, reinterpret_cast<const HPDF_BYTE *>(deflated.data()),
+                             static_cast<HPDF_UINT>(deflated.size())) == HPDF_OK;
+}
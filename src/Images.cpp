@@ -0,0 +1,258 @@
+#include "Images.h"
+#include "Diagnostics.h"
+#include <tinyxml2.h>
+#include <cstring>
+
+using namespace tinyxml2;
+
+// Part name of a relationship target of word/document.xml. Targets are
+// relative to word/ unless they start with '/'.
+static std::string resolveTarget(std::string_view target)
+{
+    if (!target.empty() && target[0] == '/')
+    {
+        return std::string(target.substr(1));
+    }
+
+    std::string part = "word";
+    while (target.compare(0, 3, "../") == 0)
+    {
+        part.clear();
+        target.remove_prefix(3);
+    }
+    if (!part.empty())
+    {
+        part += '/';
+    }
+    part.append(target.data(), target.size());
+    return part;
+}
+
+bool ImageTable::load(std::string_view relsXml)
+{
+    targets_.clear();
+    ids_.clear();
+    parts_.clear();
+    if (relsXml.empty())
+    {
+        return true;
+    }
+
+    XMLDocument doc;
+    if (doc.Parse(relsXml.data(), relsXml.size()) != XML_SUCCESS)
+    {
+        reportWarning(std::string("Failed to parse document.xml.rels: ") + doc.ErrorStr());
+        return false;
+    }
+
+    XMLElement *root = doc.RootElement();
+    for (XMLElement *rel = root ? root->FirstChildElement("Relationship") : nullptr; rel;
+         rel = rel->NextSiblingElement("Relationship"))
+    {
+        const char *id = rel->Attribute("Id");
+        const char *type = rel->Attribute("Type");
+        const char *target = rel->Attribute("Target");
+        const char *mode = rel->Attribute("TargetMode");
+        if (!id || !type || !target || (mode && strcmp(mode, "External") == 0))
+        {
+            continue; // linked images would have to be fetched, they are left out
+        }
+
+        size_t typeLength = strlen(type);
+        if (typeLength < 6 || strcmp(type + typeLength - 6, "/image") != 0)
+        {
+            continue;
+        }
+        targets_[id] = resolveTarget(target);
+    }
+    return true;
+}
+
+int ImageTable::imageId(std::string_view relId)
+{
+    auto target = targets_.find(std::string(relId));
+    if (target == targets_.end())
+    {
+        return -1;
+    }
+
+    auto it = ids_.find(target->second);
+    if (it != ids_.end())
+    {
+        return it->second;
+    }
+    int id = static_cast<int>(parts_.size());
+    parts_.push_back(target->second);
+    ids_.emplace(target->second, id);
+    return id;
+}
+
+static uint32_t readU16(const unsigned char *p)
+{
+    return static_cast<uint32_t>(p[0]) << 8 | p[1];
+}
+
+static uint32_t readU32(const unsigned char *p)
+{
+    return readU16(p) << 16 | readU16(p + 2);
+}
+
+bool readJpegInfo(std::string_view data, JpegInfo &info)
+{
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(data.data());
+    size_t size = data.size();
+    if (size < 4 || s[0] != 0xFF || s[1] != 0xD8)
+    {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (s[pos] != 0xFF)
+        {
+            return false;
+        }
+        unsigned char marker = s[pos + 1];
+        if (marker == 0xFF)
+        {
+            pos++; // fill byte
+            continue;
+        }
+        pos += 2;
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+        {
+            continue; // standalone markers carry no length
+        }
+
+        uint32_t length = readU16(s + pos);
+        if (length < 2 || pos + length > size)
+        {
+            return false;
+        }
+        const unsigned char *segment = s + pos + 2;
+
+        // SOF0 to SOF15 except DHT, JPG and DAC share the frame header layout
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            if (length < 8)
+            {
+                return false;
+            }
+            info.frame = marker;
+            info.bitsPerComponent = segment[0];
+            info.height = readU16(segment + 1);
+            info.width = readU16(segment + 3);
+            info.components = segment[5];
+            return info.width > 0 && info.height > 0 &&
+                   (info.components == 1 || info.components == 3 || info.components == 4);
+        }
+        if (marker == 0xEE && length >= 7 && memcmp(segment, "Adobe", 5) == 0)
+        {
+            info.adobe = true;
+        }
+        if (marker == 0xDA)
+        {
+            return false; // scan data before any frame header
+        }
+        pos += length;
+    }
+    return false;
+}
+
+bool JpegInfo::passThrough() const
+{
+    // SOF0 baseline, SOF1 extended and SOF2 progressive; 12-bit, lossless and
+    // arithmetic coded JPEGs are valid files but no PDF reader decodes them
+    return bitsPerComponent == 8 && (frame == 0xC0 || frame == 0xC1 || frame == 0xC2);
+}
+
+bool PngInfo::passThrough() const
+{
+    if (interlaced || transparency || idat.empty())
+    {
+        return false;
+    }
+    // An indexed color space holds at most 256 RGB entries
+    bool validPalette = !palette.empty() && palette.size() % 3 == 0 && palette.size() <= 256 * 3;
+    return colorType == 0 || colorType == 2 || (colorType == 3 && validPalette);
+}
+
+bool readPngInfo(std::string_view data, PngInfo &info)
+{
+    static const char SIGNATURE[] = "\x89PNG\r\n\x1a\n";
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(data.data());
+    size_t size = data.size();
+    if (size < 8 || memcmp(s, SIGNATURE, 8) != 0)
+    {
+        return false;
+    }
+
+    bool haveHeader = false;
+    size_t pos = 8;
+    while (pos + 12 <= size)
+    {
+        uint32_t length = readU32(s + pos);
+        if (length > size - pos - 12)
+        {
+            return false;
+        }
+        const char *type = data.data() + pos + 4;
+        std::string_view payload = data.substr(pos + 8, length);
+        pos += 12 + static_cast<size_t>(length);
+
+        if (memcmp(type, "IHDR", 4) == 0)
+        {
+            if (length < 13)
+            {
+                return false;
+            }
+            const unsigned char *header = reinterpret_cast<const unsigned char *>(payload.data());
+            info.width = readU32(header);
+            info.height = readU32(header + 4);
+            info.bitDepth = header[8];
+            info.colorType = header[9];
+            info.interlaced = header[12] != 0;
+            haveHeader = true;
+        }
+        else if (!haveHeader)
+        {
+            return false; // IHDR has to come first
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+        {
+            info.palette = payload;
+        }
+        else if (memcmp(type, "tRNS", 4) == 0)
+        {
+            info.transparency = true;
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            info.idat.push_back(payload);
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+    }
+
+    if (!haveHeader || info.width == 0 || info.height == 0)
+    {
+        return false;
+    }
+    switch (info.colorType)
+    {
+    case 0:
+        return info.bitDepth == 1 || info.bitDepth == 2 || info.bitDepth == 4 || info.bitDepth == 8 ||
+               info.bitDepth == 16;
+    case 3:
+        return info.bitDepth == 1 || info.bitDepth == 2 || info.bitDepth == 4 || info.bitDepth == 8;
+    case 2:
+    case 4:
+    case 6:
+        return info.bitDepth == 8 || info.bitDepth == 16;
+    default:
+        return false;
+    }
+}
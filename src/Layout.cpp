@@ -0,0 +1,598 @@
+#include "Layout.h"
+#include "Diagnostics.h"
+#include "Metrics.h"
+#include "TextTokenizer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <string_view>
+#include <thread>
+
+// Appends a run for text at (x, y) to the block's current line
+static void addRun(LayoutBlock &block, float x, float y, std::string_view text, const TextFragment &fragment)
+{
+    const RunFormat &format = fragment.format;
+    GlyphRun run;
+    run.x = x;
+    run.y = y;
+    run.textOffset = static_cast<uint32_t>(block.text.size());
+    run.textLength = static_cast<uint32_t>(text.size());
+    run.fontSize = static_cast<float>(format.fontSize());
+    run.r = format.red();
+    run.g = format.green();
+    run.b = format.blue();
+    run.fontId = format.fontId;
+
+    block.text.append(text.data(), text.size());
+    block.text.push_back('\0'); // so the emitter can hand the run to libharu in place
+    block.runs.push_back(run);
+    block.lines.back().runCount++;
+}
+
+// Adds text to the current line, extending the previous run instead when the
+// caller knows it continues it (same fragment, same line, directly adjacent)
+static void addText(LayoutBlock &block, float x, float y, std::string_view text,
+                    const TextFragment &format, bool &runOpen)
+{
+    if (!runOpen)
+    {
+        addRun(block, x, y, text, format);
+        runOpen = true;
+        return;
+    }
+
+    GlyphRun &run = block.runs.back();
+    block.text.pop_back(); // the run's NUL terminator
+    block.text.append(text.data(), text.size());
+    block.text.push_back('\0');
+    run.textLength += static_cast<uint32_t>(text.size());
+}
+
+static bool sameFormat(const GlyphRun &run, const TextFragment &fragment)
+{
+    const RunFormat &format = fragment.format;
+    return run.fontId == format.fontId && run.fontSize == format.fontSize() && run.r == format.red() &&
+           run.g == format.green() && run.b == format.blue();
+}
+
+static void addRule(LayoutBlock &block, float x1, float y1, float x2, float y2)
+{
+    block.rules.push_back(Rule{x1, y1, x2, y2});
+    block.lines.back().ruleCount++;
+}
+
+static void startLine(LayoutBlock &block, float advance)
+{
+    LayoutBlock::Line line;
+    line.advance = advance;
+    line.rise = 0.0f;
+    line.firstRun = static_cast<uint32_t>(block.runs.size());
+    line.runCount = 0;
+    line.firstRule = static_cast<uint32_t>(block.rules.size());
+    line.ruleCount = 0;
+    line.firstImage = static_cast<uint32_t>(block.images.size());
+    line.imageCount = 0;
+    block.lines.push_back(line);
+}
+
+// Puts an image on the current line with its bottom on the baseline. The
+// line rises by as much as the image is taller than the line's text.
+static void addImage(LayoutBlock &block, float x, float width, float height, float textHeight, int imageId)
+{
+    block.images.push_back(PlacedImage{x, 0.0f, width, height, static_cast<uint32_t>(imageId)});
+    LayoutBlock::Line &line = block.lines.back();
+    line.imageCount++;
+    line.rise = std::max(line.rise, height - textHeight);
+}
+
+// Bytes of the code point starting with lead, malformed input steps one byte
+static size_t codePointLength(unsigned char lead, size_t available)
+{
+    size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    return std::min(length, available);
+}
+
+// Length of the longest prefix of word no wider than width, at least one code
+// point so that a word wider than any line still makes progress
+static size_t fittingPrefix(TextMeasurer &measurer, FontId font, float fontSize, std::string_view word, float width)
+{
+    size_t end = codePointLength(static_cast<unsigned char>(word[0]), word.size());
+    float used = measurer.textWidth(font, fontSize, word.substr(0, end));
+    while (end < word.size())
+    {
+        size_t length = codePointLength(static_cast<unsigned char>(word[end]), word.size() - end);
+        used += measurer.textWidth(font, fontSize, word.substr(end, length));
+        if (used > width)
+            break;
+        end += length;
+    }
+    return end;
+}
+
+// Breaks a paragraph into lines at the tokenizer's break opportunities, a word
+// that doesn't fit moves to the next line while spaces never wrap. A word
+// wider than a whole line is split where it overflows.
+LayoutBlock layoutParagraph(TextMeasurer &measurer, const Paragraph &paragraph, const PageGeometry &geometry,
+                            std::pmr::memory_resource *arena)
+{
+    LayoutBlock block(arena);
+    block.kind = LayoutBlock::PARAGRAPH;
+    startLine(block, 0.0f);
+
+    const float tabWidth = 40.0f;
+    float lineEnd = geometry.width - geometry.rightMargin;
+    float cursorX = geometry.leftMargin;
+
+    // Consecutive tokens with the same formatting on one line become a single run
+    bool runOpen = false;
+
+    for (const ParagraphItem &item : paragraph.items)
+    {
+        const TextFragment &fragment = item.fragment;
+        float fontSize = static_cast<float>(fragment.format.fontSize());
+
+        if (item.kind == ParagraphItem::TAB)
+        {
+            cursorX += tabWidth;
+            runOpen = false;
+            continue;
+        }
+        if (item.kind == ParagraphItem::BREAK)
+        {
+            startLine(block, fontSize + 2.0f);
+            cursorX = geometry.leftMargin;
+            runOpen = false;
+            continue;
+        }
+        if (item.kind == ParagraphItem::IMAGE)
+        {
+            // Pictures wrap like words, scaled down to fit within the margins
+            float scale = std::min({1.0f, (lineEnd - geometry.leftMargin) / item.imageWidth,
+                                    (geometry.top() - geometry.bottomMargin - fontSize) / item.imageHeight});
+            float width = item.imageWidth * scale;
+            if (cursorX + width > lineEnd && cursorX > geometry.leftMargin)
+            {
+                startLine(block, fontSize + 2.0f);
+                cursorX = geometry.leftMargin;
+            }
+            addImage(block, cursorX, width, item.imageHeight * scale, fontSize, item.imageId);
+            cursorX += width;
+            runOpen = false;
+            continue;
+        }
+
+        if (runOpen && !sameFormat(block.runs.back(), fragment))
+        {
+            runOpen = false;
+        }
+
+        // Line breaks are BREAK items, a stray newline in the text is just whitespace
+        TextTokenizer tokens(fragment.text);
+        TextToken token;
+        while (tokens.next(token))
+        {
+            float tokenWidth = measurer.textWidth(fragment.format.font(), fontSize, token.text);
+
+            // If word doesn't fit on the current line
+            if (cursorX + tokenWidth > lineEnd && token.kind == TextToken::WORD)
+            {
+                if (cursorX > geometry.leftMargin)
+                {
+                    startLine(block, fontSize + 2.0f);
+                    cursorX = geometry.leftMargin;
+                    runOpen = false;
+                }
+                while (cursorX + tokenWidth > lineEnd)
+                {
+                    size_t fits = fittingPrefix(measurer, fragment.format.font(), fontSize, token.text, lineEnd - cursorX);
+                    if (fits == token.text.size())
+                        break;
+                    addText(block, cursorX, 0.0f, token.text.substr(0, fits), fragment, runOpen);
+                    startLine(block, fontSize + 2.0f);
+                    cursorX = geometry.leftMargin;
+                    runOpen = false;
+                    token.text.remove_prefix(fits);
+                    tokenWidth = measurer.textWidth(fragment.format.font(), fontSize, token.text);
+                }
+            }
+
+            addText(block, cursorX, 0.0f, token.text, fragment, runOpen);
+            cursorX += tokenWidth;
+        }
+    }
+
+    // Move to next line after paragraph
+    block.trailing = paragraph.endFontSize + 2.0f;
+    return block;
+}
+
+float calculateTextHeight(TextMeasurer &measurer, std::string_view text,
+                          float fontSize, FontId fontId, float cellWidth)
+{
+    int lines = 1; // Start with at least one line
+    float cursorX = 0.0f;
+
+    TextTokenizer tokens(text);
+    TextToken token;
+    while (tokens.next(token))
+    {
+        // Handle line breaks
+        if (token.kind == TextToken::NEWLINE)
+        {
+            lines++;
+            cursorX = 0.0f;
+            continue;
+        }
+
+        // Measure the token in place, no copy
+        float tokenWidth = measurer.textWidth(fontId, fontSize, token.text);
+
+        // If word doesn't fit on the current line
+        if (cursorX + tokenWidth > cellWidth && token.kind == TextToken::WORD)
+        {
+            if (cursorX > 0.0f)
+            {
+                lines++;
+                cursorX = 0.0f;
+            }
+            while (tokenWidth > cellWidth)
+            {
+                size_t fits = fittingPrefix(measurer, fontId, fontSize, token.text, cellWidth);
+                if (fits == token.text.size())
+                    break;
+                lines++;
+                token.text.remove_prefix(fits);
+                tokenWidth = measurer.textWidth(fontId, fontSize, token.text);
+            }
+        }
+
+        cursorX += tokenWidth;
+    }
+
+    // Calculate total height based on number of lines
+    float lineHeight = fontSize + 2.0f; // Adjust as necessary
+    return lines * lineHeight;
+}
+
+float calculateCellHeight(TextMeasurer &measurer, const TableCell &cell, float cellWidth)
+{
+    float totalHeight = 0.0f;
+
+    std::string replaced;
+    for (const auto &fragment : cell.textFragments)
+    {
+        // Handle line breaks, only text that has any needs a copy
+        std::string_view text = fragment.text;
+        if (text.find('\n') != std::string_view::npos)
+        {
+            replaced.assign(text.data(), text.size());
+            std::replace(replaced.begin(), replaced.end(), '\n', ' ');
+            text = replaced;
+        }
+
+        // Calculate height needed for this fragment
+        float fragmentHeight = calculateTextHeight(measurer, text, fragment.format.fontSize(), fragment.format.font(),
+                                                   cellWidth - 10); // Subtract padding
+        totalHeight += fragmentHeight;
+    }
+
+    // Ensure minimum cell height
+    float defaultLineHeight = 20.0f; // Adjust as needed
+    return std::max(totalHeight, defaultLineHeight);
+}
+
+// Lays out a fragment inside a cell starting at (cursorX, cursorY), relative to
+// the top of the row. Text below bottomY is clipped.
+static void layoutTextInCell(LayoutBlock &block, TextMeasurer &measurer, const TextFragment &fragment,
+                             float &cursorX, float &cursorY, float cellWidth, float bottomY)
+{
+    float fontSize = static_cast<float>(fragment.format.fontSize());
+    float initialX = cursorX; // Save initial X position
+    bool runOpen = false;
+
+    TextTokenizer tokens(fragment.text);
+    TextToken token;
+    while (tokens.next(token))
+    {
+        // Handle line breaks
+        if (token.kind == TextToken::NEWLINE)
+        {
+            cursorY -= fontSize + 2.0f;
+            cursorX = initialX; // Reset to left edge of cell
+            runOpen = false;
+
+            // Stop rendering if we exceed the bottom of the cell
+            if (cursorY < bottomY)
+            {
+                break;
+            }
+            continue;
+        }
+
+        float tokenWidth = measurer.textWidth(fragment.format.font(), fontSize, token.text);
+
+        // If word doesn't fit on the current line
+        if ((cursorX - initialX) + tokenWidth > cellWidth && token.kind == TextToken::WORD)
+        {
+            if (cursorX > initialX)
+            {
+                cursorY -= fontSize + 2.0f;
+                cursorX = initialX; // Reset to left edge of cell
+                runOpen = false;
+            }
+            while (tokenWidth > cellWidth && cursorY >= bottomY)
+            {
+                size_t fits = fittingPrefix(measurer, fragment.format.font(), fontSize, token.text, cellWidth);
+                if (fits == token.text.size())
+                    break;
+                addText(block, cursorX, cursorY, token.text.substr(0, fits), fragment, runOpen);
+                cursorY -= fontSize + 2.0f;
+                runOpen = false;
+                token.text.remove_prefix(fits);
+                tokenWidth = measurer.textWidth(fragment.format.font(), fontSize, token.text);
+            }
+
+            // Stop rendering if we exceed the bottom of the cell
+            if (cursorY < bottomY)
+            {
+                break;
+            }
+        }
+
+        addText(block, cursorX, cursorY, token.text, fragment, runOpen);
+
+        cursorX += tokenWidth;
+    }
+}
+
+LayoutBlock layoutTable(TextMeasurer &measurer, const Table &table, const PageGeometry &geometry,
+                        std::pmr::memory_resource *arena)
+{
+    LayoutBlock block(arena);
+    block.kind = LayoutBlock::TABLE;
+    if (table.rows.empty()) return block;
+
+    // Table properties
+    float tableStartX = geometry.leftMargin;
+    float tableWidth = geometry.width - geometry.leftMargin - geometry.rightMargin;
+
+    // Determine the maximum number of columns considering gridSpans
+    size_t numCols = 0;
+    for (const auto &row : table.rows)
+    {
+        size_t colCount = 0;
+        for (const auto &cell : row)
+        {
+            colCount += cell.gridSpan;
+        }
+        numCols = std::max(numCols, colCount);
+    }
+
+    if (numCols == 0)
+    {
+        reportWarning("Table has zero columns, it is left out.");
+        return block;
+    }
+
+    // Define column widths (evenly distributed)
+    std::pmr::vector<float> colWidths(numCols, tableWidth / numCols, arena);
+    std::pmr::vector<float> cellWidths(arena);
+
+    // Row heights only depend on the cells' text and widths, so the whole table
+    // is measured up front, on several cores for long tables. The memo in a
+    // TextMeasurer isn't shared between threads: the calling thread keeps using
+    // the document's measurer and every other chunk gets a fresh one.
+    StageTimer measureTimer(STAGE_CELL_MEASURE);
+    std::pmr::vector<float> rowHeights(table.rows.size(), 0.0f, arena);
+    std::atomic<uint64_t> helperTokens(0);
+    std::thread::id caller = std::this_thread::get_id();
+    parallelFor(table.rows.size(), 32, [&](size_t begin, size_t end) {
+        TextMeasurer local;
+        bool onCaller = std::this_thread::get_id() == caller;
+        if (!onCaller)
+        {
+            local = measurer.sharingFonts();
+        }
+        TextMeasurer &rowMeasurer = onCaller ? measurer : local;
+
+        for (size_t r = begin; r < end; ++r)
+        {
+            float maxCellHeight = 0.0f;
+            size_t colIndex = 0;
+            for (const auto &cell : table.rows[r])
+            {
+                float cellWidth = 0.0f;
+                for (size_t i = 0; i < cell.gridSpan && (colIndex + i) < numCols; ++i)
+                {
+                    cellWidth += colWidths[colIndex + i];
+                }
+                maxCellHeight = std::max(maxCellHeight, calculateCellHeight(rowMeasurer, cell, cellWidth));
+                colIndex += cell.gridSpan;
+            }
+            rowHeights[r] = maxCellHeight;
+        }
+
+        if (!onCaller)
+        {
+            helperTokens += local.tokensMeasured();
+        }
+    });
+    measureTimer.stop();
+    countMetric(COUNTER_TOKENS_MEASURED, helperTokens);
+
+    // Iterate over each row
+    for (size_t rowIndex = 0; rowIndex < table.rows.size(); ++rowIndex)
+    {
+        const auto &row = table.rows[rowIndex];
+        float maxCellHeight = rowHeights[rowIndex];
+        cellWidths.clear();
+
+        // Cell widths, the same sums the measuring pass used
+        size_t colIndex = 0;
+        for (const auto &cell : row)
+        {
+            size_t span = cell.gridSpan;
+            float cellWidth = 0.0f;
+            for (size_t i = 0; i < span && (colIndex + i) < numCols; ++i)
+            {
+                cellWidth += colWidths[colIndex + i];
+            }
+            cellWidths.push_back(cellWidth);
+            colIndex += span;
+        }
+
+        // Everything in the row is relative to its top edge at y = 0
+        startLine(block, maxCellHeight);
+
+        // Horizontal line for the top of the row
+        addRule(block, tableStartX, 0.0f, tableStartX + tableWidth, 0.0f);
+
+        // Vertical lines at cell boundaries
+        float cellX = tableStartX;
+        addRule(block, cellX, 0.0f, cellX, -maxCellHeight);
+        for (float cellWidth : cellWidths)
+        {
+            cellX += cellWidth;
+            addRule(block, cellX, 0.0f, cellX, -maxCellHeight);
+        }
+
+        // Vertical lines for any remaining columns
+        while (colIndex < numCols)
+        {
+            cellX += colWidths[colIndex];
+            addRule(block, cellX, 0.0f, cellX, -maxCellHeight);
+            colIndex++;
+        }
+
+        // Cell content
+        cellX = tableStartX;
+        size_t cellIndex = 0;
+
+        for (const auto &cell : row)
+        {
+            float cellWidth = cellWidths[cellIndex];
+
+            float textCursorX = cellX + 5;       // Padding from left
+            float textCursorY = -5.0f;           // Start from top of cell, adjust padding
+            float bottomY = -maxCellHeight + 5;  // Adjust padding
+            float availableWidth = cellWidth - 10; // Subtract padding
+
+            for (const auto &fragment : cell.textFragments)
+            {
+                float tempCursorX = textCursorX;
+                float tempCursorY = textCursorY;
+
+                layoutTextInCell(block, measurer, fragment, tempCursorX, tempCursorY, availableWidth, bottomY);
+
+                textCursorY = tempCursorY; // Update textCursorY after rendering
+            }
+
+            cellX += cellWidth;
+            cellIndex++;
+        }
+
+        // Horizontal line for the bottom of the row
+        addRule(block, tableStartX, -maxCellHeight, tableStartX + tableWidth, -maxCellHeight);
+    }
+
+    // Space after table
+    block.trailing = 10.0f;
+    return block;
+}
+
+Paginator::Paginator(Layout &layout) : layout_(layout)
+{
+    newPage();
+}
+
+void Paginator::newPage()
+{
+    LayoutPage page;
+    page.firstRun = static_cast<uint32_t>(layout_.runs.size());
+    page.firstRule = static_cast<uint32_t>(layout_.rules.size());
+    page.firstImage = static_cast<uint32_t>(layout_.images.size());
+    layout_.pages.push_back(page);
+    cursorY_ = layout_.geometry.top();
+}
+
+void Paginator::placeLine(const LayoutBlock &block, const LayoutBlock::Line &line, float y, uint32_t textBase)
+{
+    LayoutPage &page = layout_.pages.back();
+
+    for (uint32_t i = line.firstRun; i < line.firstRun + line.runCount; ++i)
+    {
+        GlyphRun run = block.runs[i];
+        run.y += y;
+        run.textOffset += textBase;
+        layout_.runs.push_back(run);
+    }
+    page.runCount += line.runCount;
+
+    for (uint32_t i = line.firstRule; i < line.firstRule + line.ruleCount; ++i)
+    {
+        Rule rule = block.rules[i];
+        rule.y1 += y;
+        rule.y2 += y;
+        layout_.rules.push_back(rule);
+    }
+    page.ruleCount += line.ruleCount;
+
+    for (uint32_t i = line.firstImage; i < line.firstImage + line.imageCount; ++i)
+    {
+        PlacedImage image = block.images[i];
+        image.y += y;
+        layout_.images.push_back(image);
+    }
+    page.imageCount += line.imageCount;
+}
+
+void Paginator::place(const LayoutBlock &block)
+{
+    uint32_t textBase = static_cast<uint32_t>(layout_.text.size());
+    layout_.text += block.text;
+
+    float bottom = layout_.geometry.bottomMargin;
+
+    if (block.kind == LayoutBlock::PARAGRAPH)
+    {
+        // The first line goes where the cursor is, every later one moves down
+        // first. A line holding a tall image moves down further by its rise,
+        // also at the top of a page.
+        for (size_t i = 0; i < block.lines.size(); ++i)
+        {
+            const LayoutBlock::Line &line = block.lines[i];
+            float drop = (i > 0 ? line.advance : 0.0f) + line.rise;
+            if (drop > 0.0f)
+            {
+                cursorY_ -= drop;
+                if (cursorY_ < bottom)
+                {
+                    newPage();
+                    cursorY_ -= line.rise;
+                }
+            }
+            placeLine(block, line, cursorY_, textBase);
+        }
+
+        cursorY_ -= block.trailing;
+        if (cursorY_ < bottom)
+        {
+            newPage();
+        }
+    }
+    else
+    {
+        // Rows are never split, a row that doesn't fit starts a new page
+        for (const LayoutBlock::Line &row : block.lines)
+        {
+            if (cursorY_ - row.advance < bottom)
+            {
+                newPage();
+            }
+            placeLine(block, row, cursorY_, textBase);
+            cursorY_ -= row.advance;
+        }
+
+        cursorY_ -= block.trailing;
+    }
+}
@@ -0,0 +1,86 @@
+#include "LayoutCache.h"
+
+static std::unique_ptr<LayoutCache> processCache;
+
+void LayoutCache::enable(size_t maxBytes)
+{
+    processCache.reset(maxBytes ? new LayoutCache(maxBytes) : nullptr);
+}
+
+LayoutCache *LayoutCache::instance()
+{
+    return processCache.get();
+}
+
+Hash128 LayoutCache::keyFor(std::string_view elementXml, const PageGeometry &geometry, uint64_t stylesFingerprint)
+{
+    // The geometry and styles seed the hash, the same element laid out for
+    // another width or under other styles is another entry
+    float dimensions[6] = {geometry.width,      geometry.height,    geometry.leftMargin,
+                           geometry.rightMargin, geometry.topMargin, geometry.bottomMargin};
+    Hash128 seed =
+        hash128(std::string_view(reinterpret_cast<const char *>(dimensions), sizeof(dimensions)), stylesFingerprint);
+    return hash128(elementXml, seed.low ^ seed.high);
+}
+
+std::shared_ptr<const LayoutBlock> LayoutCache::find(const Hash128 &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end())
+    {
+        stats_.misses++;
+        return nullptr;
+    }
+    recency_.splice(recency_.begin(), recency_, it->second.recency);
+    stats_.hits++;
+    return it->second.block;
+}
+
+void LayoutCache::insert(const Hash128 &key, const LayoutBlock &block)
+{
+    // Copied out of the conversion's arena into memory the cache owns
+    auto copy = std::make_shared<LayoutBlock>();
+    copy->kind = block.kind;
+    copy->lines.assign(block.lines.begin(), block.lines.end());
+    copy->runs.assign(block.runs.begin(), block.runs.end());
+    copy->rules.assign(block.rules.begin(), block.rules.end());
+    copy->images.assign(block.images.begin(), block.images.end());
+    copy->text.assign(block.text.data(), block.text.size());
+    copy->trailing = block.trailing;
+
+    size_t size = sizeof(LayoutBlock) + copy->lines.size() * sizeof(LayoutBlock::Line) +
+                  copy->runs.size() * sizeof(GlyphRun) + copy->rules.size() * sizeof(Rule) +
+                  copy->images.size() * sizeof(PlacedImage) + copy->text.size();
+    if (size > maxBytes_)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+    {
+        // Laid out concurrently by two conversions, both results are the same
+        return;
+    }
+    recency_.push_front(key);
+    entries_[key] = Entry{std::move(copy), size, recency_.begin()};
+    stats_.bytes += size;
+
+    while (stats_.bytes > maxBytes_ && !recency_.empty())
+    {
+        auto victim = entries_.find(recency_.back());
+        stats_.bytes -= victim->second.size;
+        stats_.evictions++;
+        entries_.erase(victim);
+        recency_.pop_back();
+    }
+    stats_.entries = entries_.size();
+}
+
+LayoutCache::Stats LayoutCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
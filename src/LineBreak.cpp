@@ -0,0 +1,348 @@
+#include "LineBreak.h"
+#include <cstdint>
+
+namespace
+{
+
+// The UAX #14 classes the pair rules tell apart. Resolved as in the
+// standard's defaults: AI, SA, SG and XX are AL, CJ is ID (normal, not
+// strict, breaking), RI is AL and emoji modifiers are CM. Spaces and hard
+// breaks never get here, the tokenizer splits on them first.
+enum Class : uint8_t
+{
+    AL, BA, BB, B2, CL, CM, CP, EX, GL, HY, ID, IN, IS, NS, NU, OP, PO, PR, QU, SY, WJ, ZW, ZWJ,
+    H2, H3, JL, JV, JT,
+    CLASS_COUNT,
+    OP_CL = CLASS_COUNT // only in RANGES: brackets alternating OP, CL from the first code point on
+};
+
+struct Range
+{
+    char32_t first, last;
+    Class cls;
+};
+
+// Condensed from LineBreak.txt for the scripts a DOCX body commonly holds:
+// Latin, Greek, Cyrillic, Hebrew, Arabic, Devanagari, CJK, Hangul, the
+// punctuation blocks and emoji. Code points in no range are AL. Sorted.
+constexpr Range RANGES[] = {
+    {0x00, 0x08, CM}, {0x0E, 0x1F, CM}, {0x21, 0x21, EX}, {0x22, 0x22, QU}, {0x24, 0x24, PR},
+    {0x25, 0x25, PO}, {0x27, 0x27, QU}, {0x28, 0x28, OP}, {0x29, 0x29, CP}, {0x2B, 0x2B, PR},
+    {0x2C, 0x2C, IS}, {0x2D, 0x2D, HY}, {0x2E, 0x2E, IS}, {0x2F, 0x2F, SY}, {0x30, 0x39, NU},
+    {0x3A, 0x3B, IS}, {0x3F, 0x3F, EX}, {0x5B, 0x5B, OP}, {0x5C, 0x5C, PR}, {0x5D, 0x5D, CP},
+    {0x7B, 0x7B, OP}, {0x7C, 0x7C, BA}, {0x7D, 0x7D, CL}, {0x7F, 0x84, CM}, {0x86, 0x9F, CM},
+    {0xA0, 0xA0, GL}, {0xA1, 0xA1, OP}, {0xA2, 0xA2, PO}, {0xA3, 0xA5, PR}, {0xAB, 0xAB, QU},
+    {0xAD, 0xAD, BA}, {0xB0, 0xB0, PO}, {0xB1, 0xB1, PR}, {0xB4, 0xB4, BB}, {0xBB, 0xBB, QU},
+    {0xBF, 0xBF, OP}, {0x2C8, 0x2C8, BB}, {0x2CC, 0x2CC, BB}, {0x2DF, 0x2DF, BB},
+    {0x300, 0x34E, CM}, {0x34F, 0x34F, GL}, {0x350, 0x35B, CM}, {0x35C, 0x362, GL}, {0x363, 0x36F, CM},
+    {0x37E, 0x37E, IS}, {0x483, 0x489, CM}, {0x589, 0x589, IS}, {0x58A, 0x58A, BA},
+    {0x591, 0x5BD, CM}, {0x5BE, 0x5BE, BA}, {0x5BF, 0x5BF, CM}, {0x5C1, 0x5C2, CM}, {0x5C4, 0x5C5, CM},
+    {0x5C7, 0x5C7, CM}, {0x60C, 0x60D, IS}, {0x610, 0x61A, CM}, {0x61F, 0x61F, EX}, {0x64B, 0x65F, CM},
+    {0x660, 0x669, NU}, {0x66A, 0x66A, PO}, {0x66B, 0x66C, NU}, {0x670, 0x670, CM}, {0x6D4, 0x6D4, EX},
+    {0x6D6, 0x6DC, CM}, {0x6DF, 0x6E4, CM}, {0x6E7, 0x6E8, CM}, {0x6EA, 0x6ED, CM}, {0x6F0, 0x6F9, NU},
+    {0x900, 0x903, CM}, {0x93A, 0x93C, CM}, {0x93E, 0x94F, CM}, {0x951, 0x957, CM}, {0x962, 0x963, CM},
+    {0x964, 0x965, BA}, {0x966, 0x96F, NU}, {0xE50, 0xE59, NU}, {0xE5A, 0xE5B, BA}, {0xF0B, 0xF0B, BA},
+    {0x1100, 0x115F, JL}, {0x1160, 0x11A7, JV}, {0x11A8, 0x11FF, JT}, {0x1680, 0x1680, BA},
+    {0x17D4, 0x17D5, BA}, {0x1806, 0x1806, BB}, {0x1AB0, 0x1AFF, CM}, {0x1DC0, 0x1DFF, CM},
+    // General punctuation
+    {0x2000, 0x2006, BA}, {0x2007, 0x2007, GL}, {0x2008, 0x200A, BA}, {0x200B, 0x200B, ZW},
+    {0x200C, 0x200C, CM}, {0x200D, 0x200D, ZWJ}, {0x200E, 0x200F, CM}, {0x2010, 0x2010, BA},
+    {0x2011, 0x2011, GL}, {0x2012, 0x2013, BA}, {0x2014, 0x2014, B2}, {0x2018, 0x2019, QU},
+    {0x201A, 0x201A, OP}, {0x201B, 0x201D, QU}, {0x201E, 0x201E, OP}, {0x201F, 0x201F, QU},
+    {0x2024, 0x2026, IN}, {0x2027, 0x2027, BA}, {0x202A, 0x202E, CM}, {0x202F, 0x202F, GL},
+    {0x2030, 0x2037, PO}, {0x2039, 0x203A, QU}, {0x203C, 0x203D, NS}, {0x2044, 0x2044, IS},
+    {0x2045, 0x2045, OP}, {0x2046, 0x2046, CL}, {0x2047, 0x2049, NS}, {0x2056, 0x2056, BA},
+    {0x2058, 0x205B, BA}, {0x205D, 0x205E, BA}, {0x2060, 0x2060, WJ}, {0x2066, 0x206F, CM},
+    {0x207D, 0x207D, OP}, {0x207E, 0x207E, CL}, {0x208D, 0x208D, OP}, {0x208E, 0x208E, CL},
+    {0x20A0, 0x20A6, PR}, {0x20A7, 0x20A7, PO}, {0x20A8, 0x20B5, PR}, {0x20B6, 0x20B6, PO},
+    {0x20B7, 0x20BA, PR}, {0x20BB, 0x20BB, PO}, {0x20BC, 0x20BD, PR}, {0x20BE, 0x20BE, PO},
+    {0x20BF, 0x20CF, PR}, {0x20D0, 0x20FF, CM}, {0x2103, 0x2103, PO}, {0x2109, 0x2109, PO},
+    {0x2116, 0x2116, PR}, {0x2212, 0x2213, PR}, {0x2308, 0x230B, OP_CL}, {0x2329, 0x232A, OP_CL},
+    {0x2768, 0x2775, OP_CL}, {0x27C5, 0x27C6, OP_CL}, {0x27E6, 0x27EF, OP_CL}, {0x2983, 0x2998, OP_CL},
+    {0x29D8, 0x29DB, OP_CL}, {0x29FC, 0x29FD, OP_CL}, {0x2E18, 0x2E18, OP}, {0x2E22, 0x2E29, OP_CL},
+    // CJK symbols, kana and ideographs
+    {0x2E80, 0x2FFF, ID}, {0x3000, 0x3000, BA}, {0x3001, 0x3002, CL}, {0x3003, 0x3004, ID},
+    {0x3005, 0x3005, NS}, {0x3006, 0x3007, ID}, {0x3008, 0x3011, OP_CL}, {0x3012, 0x3013, ID},
+    {0x3014, 0x301B, OP_CL}, {0x301C, 0x301C, NS}, {0x301D, 0x301D, OP}, {0x301E, 0x301F, CL},
+    {0x3020, 0x3029, ID}, {0x302A, 0x302F, CM}, {0x3030, 0x303A, ID}, {0x303B, 0x303C, NS},
+    {0x303D, 0x3098, ID}, {0x3099, 0x309A, CM}, {0x309B, 0x309E, NS}, {0x309F, 0x309F, ID},
+    {0x30A0, 0x30A0, NS}, {0x30A1, 0x30FA, ID}, {0x30FB, 0x30FB, NS}, {0x30FC, 0x30FC, ID},
+    {0x30FD, 0x30FE, NS}, {0x30FF, 0x4DBF, ID}, {0x4E00, 0x9FFF, ID}, {0xA000, 0xA014, ID},
+    {0xA015, 0xA015, NS}, {0xA016, 0xA4CF, ID},
+    // Hangul, syllables are H3 except the LV ones, see classOf()
+    {0xAC00, 0xD7A3, H3}, {0xD7B0, 0xD7C6, JV}, {0xD7CB, 0xD7FB, JT},
+    {0xF900, 0xFAFF, ID}, {0xFE00, 0xFE0F, CM}, {0xFE10, 0xFE10, IS}, {0xFE11, 0xFE12, CL},
+    {0xFE13, 0xFE14, IS}, {0xFE15, 0xFE16, EX}, {0xFE17, 0xFE18, OP_CL}, {0xFE19, 0xFE19, IN},
+    {0xFE20, 0xFE2F, CM}, {0xFE30, 0xFE34, ID}, {0xFE35, 0xFE44, OP_CL}, {0xFE45, 0xFE46, ID},
+    {0xFE47, 0xFE48, OP_CL}, {0xFE49, 0xFE4F, ID}, {0xFE50, 0xFE50, CL}, {0xFE51, 0xFE51, ID},
+    {0xFE52, 0xFE52, CL}, {0xFE54, 0xFE55, NS}, {0xFE56, 0xFE57, EX}, {0xFE58, 0xFE58, ID},
+    {0xFE59, 0xFE5E, OP_CL}, {0xFE5F, 0xFE68, ID}, {0xFE69, 0xFE69, PR}, {0xFE6A, 0xFE6A, PO},
+    {0xFE6B, 0xFE6B, ID}, {0xFEFF, 0xFEFF, WJ},
+    // Fullwidth and halfwidth forms
+    {0xFF01, 0xFF01, EX}, {0xFF02, 0xFF03, ID}, {0xFF04, 0xFF04, PR}, {0xFF05, 0xFF05, PO},
+    {0xFF06, 0xFF07, ID}, {0xFF08, 0xFF09, OP_CL}, {0xFF0A, 0xFF0B, ID}, {0xFF0C, 0xFF0C, CL},
+    {0xFF0D, 0xFF0D, ID}, {0xFF0E, 0xFF0E, CL}, {0xFF0F, 0xFF19, ID}, {0xFF1A, 0xFF1B, NS},
+    {0xFF1C, 0xFF1E, ID}, {0xFF1F, 0xFF1F, EX}, {0xFF20, 0xFF3A, ID}, {0xFF3B, 0xFF3B, OP},
+    {0xFF3C, 0xFF3C, ID}, {0xFF3D, 0xFF3D, CL}, {0xFF3E, 0xFF5A, ID}, {0xFF5B, 0xFF5B, OP},
+    {0xFF5C, 0xFF5C, ID}, {0xFF5D, 0xFF5D, CL}, {0xFF5E, 0xFF5E, ID}, {0xFF5F, 0xFF5F, OP},
+    {0xFF60, 0xFF61, CL}, {0xFF62, 0xFF62, OP}, {0xFF63, 0xFF64, CL}, {0xFF65, 0xFF65, NS},
+    {0xFF66, 0xFF9D, ID}, {0xFF9E, 0xFF9F, NS}, {0xFFE0, 0xFFE0, PO}, {0xFFE1, 0xFFE1, PR},
+    {0xFFE2, 0xFFE4, ID}, {0xFFE5, 0xFFE6, PR},
+    // Emoji and the supplementary ideograph planes
+    {0x1F000, 0x1F1E5, ID}, {0x1F200, 0x1F3FA, ID}, {0x1F3FB, 0x1F3FF, CM}, {0x1F400, 0x1FAFF, ID},
+    {0x20000, 0x3FFFD, ID},
+};
+constexpr size_t RANGE_COUNT = sizeof(RANGES) / sizeof(RANGES[0]);
+
+constexpr bool rangesSorted()
+{
+    for (size_t i = 0; i < RANGE_COUNT; ++i)
+    {
+        if (RANGES[i].first > RANGES[i].last || (i > 0 && RANGES[i - 1].last >= RANGES[i].first))
+            return false;
+    }
+    return true;
+}
+static_assert(rangesSorted(), "line break ranges must be sorted and disjoint");
+
+// Stage one maps each block of 128 code points either straight to the class
+// all of them share (UNIFORM set) or to its row of per-code-point classes
+// in stage two. Only blocks where ranges begin or end need a row.
+constexpr char32_t TABLE_END = 0x40000;
+constexpr int BLOCK_SHIFT = 7;
+constexpr char32_t BLOCK_SIZE = 1 << BLOCK_SHIFT;
+constexpr size_t BLOCK_COUNT = TABLE_END >> BLOCK_SHIFT;
+constexpr uint16_t UNIFORM = 0x8000;
+
+constexpr Class rangeClass(const Range &range, char32_t cp)
+{
+    if (range.cls == OP_CL)
+        return (cp - range.first) % 2 ? CL : OP;
+    return range.cls;
+}
+
+// First range from r on that doesn't end before cp
+constexpr size_t seekRange(size_t r, char32_t cp)
+{
+    while (r < RANGE_COUNT && RANGES[r].last < cp)
+        ++r;
+    return r;
+}
+
+// Whether every code point of block has the same class, r being seekRange() of its start
+constexpr bool uniformBlock(size_t block, size_t r, Class &cls)
+{
+    char32_t first = static_cast<char32_t>(block << BLOCK_SHIFT);
+    char32_t last = first + BLOCK_SIZE - 1;
+    if (r == RANGE_COUNT || RANGES[r].first > last)
+    {
+        cls = AL;
+        return true;
+    }
+    if (RANGES[r].first <= first && RANGES[r].last >= last && RANGES[r].cls != OP_CL)
+    {
+        cls = RANGES[r].cls;
+        return true;
+    }
+    return false;
+}
+
+constexpr size_t countMixedBlocks()
+{
+    size_t count = 0;
+    size_t r = 0;
+    for (size_t block = 0; block < BLOCK_COUNT; ++block)
+    {
+        Class cls = AL;
+        r = seekRange(r, static_cast<char32_t>(block << BLOCK_SHIFT));
+        if (!uniformBlock(block, r, cls))
+            ++count;
+    }
+    return count;
+}
+constexpr size_t MIXED_BLOCKS = countMixedBlocks();
+
+struct ClassTable
+{
+    uint16_t blocks[BLOCK_COUNT];
+    uint8_t classes[MIXED_BLOCKS << BLOCK_SHIFT];
+};
+
+constexpr ClassTable buildClassTable()
+{
+    ClassTable table{};
+    size_t mixed = 0;
+    size_t r = 0;
+    for (size_t block = 0; block < BLOCK_COUNT; ++block)
+    {
+        Class cls = AL;
+        char32_t first = static_cast<char32_t>(block << BLOCK_SHIFT);
+        r = seekRange(r, first);
+        if (uniformBlock(block, r, cls))
+        {
+            table.blocks[block] = static_cast<uint16_t>(UNIFORM | cls);
+            continue;
+        }
+
+        table.blocks[block] = static_cast<uint16_t>(mixed);
+        size_t at = r;
+        for (char32_t offset = 0; offset < BLOCK_SIZE; ++offset)
+        {
+            char32_t cp = first + offset;
+            at = seekRange(at, cp);
+            bool inRange = at < RANGE_COUNT && RANGES[at].first <= cp;
+            table.classes[(mixed << BLOCK_SHIFT) + offset] = inRange ? rangeClass(RANGES[at], cp) : AL;
+        }
+        ++mixed;
+    }
+    return table;
+}
+constexpr ClassTable CLASSES = buildClassTable();
+
+// Whether a line may break between two adjacent code points of a word, by
+// the rules of UAX #14 that can apply without spaces in between. Combining
+// marks and ZWJ are resolved by the caller (LB8a, LB9, LB10).
+constexpr bool breakAllowed(Class before, Class after)
+{
+    if (after == ZW)
+        return false; // LB7
+    if (before == ZW)
+        return true; // LB8
+    if (before == WJ || after == WJ || before == GL)
+        return false; // LB11, LB12
+    if (after == GL)
+        return before == BA || before == HY; // LB12a
+    if (after == CL || after == CP || after == EX || after == IS || after == SY)
+        return false; // LB13
+    if (before == OP)
+        return false; // LB14
+    if ((before == CL || before == CP) && after == NS)
+        return false; // LB16
+    if (before == B2 && after == B2)
+        return false; // LB17
+    if (before == QU || after == QU)
+        return false; // LB19
+    if (after == BA || after == HY || after == NS || before == BB)
+        return false; // LB21
+    if (after == IN)
+        return false; // LB22
+    if ((before == AL && after == NU) || (before == NU && after == AL))
+        return false; // LB23
+    if ((before == PR && after == ID) || (before == ID && after == PO))
+        return false; // LB23a
+    if (((before == PR || before == PO) && after == AL) || (before == AL && (after == PR || after == PO)))
+        return false; // LB24
+    if ((before == CL || before == CP || before == NU) && (after == PO || after == PR))
+        return false; // LB25
+    if ((before == PO || before == PR) && (after == OP || after == NU))
+        return false;
+    if ((before == HY || before == IS || before == NU || before == SY) && after == NU)
+        return false;
+
+    bool beforeKorean = before == JL || before == JV || before == JT || before == H2 || before == H3;
+    bool afterKorean = after == JL || after == JV || after == JT || after == H2 || after == H3;
+    if (before == JL && (after == JL || after == JV || after == H2 || after == H3))
+        return false; // LB26
+    if ((before == JV || before == H2) && (after == JV || after == JT))
+        return false;
+    if ((before == JT || before == H3) && after == JT)
+        return false;
+    if ((beforeKorean && after == PO) || (before == PR && afterKorean))
+        return false; // LB27
+
+    if (before == AL && after == AL)
+        return false; // LB28
+    if (before == IS && after == AL)
+        return false; // LB29
+    if (((before == AL || before == NU) && after == OP) || (before == CP && (after == AL || after == NU)))
+        return false; // LB30
+    return true;      // LB31
+}
+
+struct PairTable
+{
+    bool allowed[CLASS_COUNT][CLASS_COUNT];
+};
+
+constexpr PairTable buildPairTable()
+{
+    PairTable table{};
+    for (int before = 0; before < CLASS_COUNT; ++before)
+    {
+        for (int after = 0; after < CLASS_COUNT; ++after)
+            table.allowed[before][after] = breakAllowed(static_cast<Class>(before), static_cast<Class>(after));
+    }
+    return table;
+}
+constexpr PairTable PAIRS = buildPairTable();
+
+inline Class classOf(char32_t cp)
+{
+    if (cp >= TABLE_END)
+        return cp >= 0xE0000 && cp <= 0xE01EF ? CM : AL; // tags and variation selectors
+
+    uint16_t entry = CLASSES.blocks[cp >> BLOCK_SHIFT];
+    Class cls = entry & UNIFORM ? static_cast<Class>(entry & 0xFF)
+                                : static_cast<Class>(CLASSES.classes[(entry << BLOCK_SHIFT) | (cp & (BLOCK_SIZE - 1))]);
+
+    // Every 28th syllable from U+AC00 is LV, as a range list it would take thousands of entries
+    if (cls == H3 && cp >= 0xAC00 && (cp - 0xAC00) % 28 == 0)
+        return H2;
+    return cls;
+}
+
+// The code point at s, malformed bytes decode one at a time as U+FFFD
+inline char32_t decodeUtf8(const unsigned char *s, size_t available, size_t &length)
+{
+    unsigned char lead = s[0];
+    length = 1;
+    if (lead < 0x80)
+        return lead;
+
+    size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+    if (need == 0 || need > available)
+        return 0xFFFD;
+    char32_t cp = lead & (0x7F >> need);
+    for (size_t i = 1; i < need; ++i)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0xFFFD;
+        cp = cp << 6 | (s[i] & 0x3F);
+    }
+    length = need;
+    return cp;
+}
+
+} // namespace
+
+size_t unbreakablePrefix(std::string_view word)
+{
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(word.data());
+    size_t len = word.size();
+    if (len == 0)
+        return 0;
+
+    size_t length;
+    Class before = classOf(decodeUtf8(s, len, length));
+    bool joined = before == ZWJ;
+    if (before == CM || before == ZWJ)
+        before = AL; // LB10
+
+    for (size_t pos = length; pos < len; pos += length)
+    {
+        Class after = classOf(decodeUtf8(s + pos, len - pos, length));
+        if (before == ZW)
+            return pos; // LB8 wins over LB9
+        if (after == CM || after == ZWJ)
+        {
+            // LB9: marks take the class of what they follow, LB8a: nothing breaks after ZWJ
+            joined = after == ZWJ;
+            continue;
+        }
+        if (!joined && PAIRS.allowed[before][after])
+            return pos;
+        joined = false;
+        before = after;
+    }
+    return len;
+}
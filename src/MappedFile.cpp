@@ -0,0 +1,61 @@
+#include "MappedFile.h"
+#include "Diagnostics.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        reportError(CONVERT_IO_ERROR, "Failed to open " + path + ": " + strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        reportError(CONVERT_IO_ERROR, "Failed to stat " + path + ": " + strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    // mmap of an empty file fails, an empty mapping is still a valid result
+    if (info.st_size > 0)
+    {
+        void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            reportError(CONVERT_IO_ERROR, "Failed to map " + path + ": " + strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        data_ = mapping;
+        size_ = info.st_size;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data_)
+    {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+}
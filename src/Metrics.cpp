@@ -0,0 +1,144 @@
+#include "Metrics.h"
+#include <iomanip>
+
+static thread_local ConversionMetrics *tlsMetrics = nullptr;
+static thread_local AllocationCounts tlsAllocations;
+
+bool allocationHookInstalled = false;
+
+const char *metricStageName(MetricStage stage)
+{
+    static const char *const names[STAGE_COUNT] = {"unzip", "xml_parse", "layout", "cell_measure", "emit", "save"};
+    return names[stage];
+}
+
+const char *metricCounterName(MetricCounter counter)
+{
+    static const char *const names[COUNTER_COUNT] = {"bytes_decompressed", "xml_nodes",       "tokens_measured",
+                                                     "pages_emitted",      "allocations",     "allocated_bytes",
+                                                     "layout_cache_hits",  "images_embedded"};
+    return names[counter];
+}
+
+ConversionMetrics *currentMetrics()
+{
+    return tlsMetrics;
+}
+
+AllocationCounts &threadAllocationCounts()
+{
+    return tlsAllocations;
+}
+
+static double toMillis(uint64_t nanos)
+{
+    return nanos / 1e6;
+}
+
+// Allocation counters are left out when nothing counts allocations
+static void writeCounters(std::ostream &out, const uint64_t (&counters)[COUNTER_COUNT])
+{
+    bool first = true;
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+    {
+        if (!allocationHookInstalled && (counter == COUNTER_ALLOCATIONS || counter == COUNTER_ALLOCATED_BYTES))
+            continue;
+
+        out << (first ? "\"" : ", \"") << metricCounterName(static_cast<MetricCounter>(counter))
+            << "\": " << counters[counter];
+        first = false;
+    }
+}
+
+void ConversionMetrics::writeJson(std::ostream &out) const
+{
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3) << "{\"total_ms\": " << toMillis(totalNanos) << ", \"stages_ms\": {";
+    for (int stage = 0; stage < STAGE_COUNT; ++stage)
+    {
+        out << (stage ? ", \"" : "\"") << metricStageName(static_cast<MetricStage>(stage))
+            << "\": " << toMillis(stageNanos[stage]);
+    }
+    out << "}, \"counters\": {";
+    writeCounters(out, counters);
+    out << "}}";
+    out.flags(flags);
+}
+
+MetricsScope::MetricsScope(ConversionMetrics *metrics)
+    : metrics_(metrics), previous_(tlsMetrics), start_(std::chrono::steady_clock::now()),
+      allocations_(tlsAllocations.allocations), allocatedBytes_(tlsAllocations.bytes)
+{
+    if (metrics_)
+        tlsMetrics = metrics_;
+}
+
+MetricsScope::~MetricsScope()
+{
+    if (!metrics_)
+        return;
+
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    metrics_->totalNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    metrics_->counters[COUNTER_ALLOCATIONS] += tlsAllocations.allocations - allocations_;
+    metrics_->counters[COUNTER_ALLOCATED_BYTES] += tlsAllocations.bytes - allocatedBytes_;
+    tlsMetrics = previous_;
+}
+
+int MetricsAggregate::bucketFor(uint64_t nanos)
+{
+    // Bucket 0 is anything under 1 ms
+    uint64_t millis = nanos / 1000000;
+    int bucket = 0;
+    while (millis > 0 && bucket < BUCKETS - 1)
+    {
+        millis >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void MetricsAggregate::add(const ConversionMetrics &metrics)
+{
+    conversions_++;
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+    {
+        counters_[counter] += metrics.counters[counter];
+    }
+    for (int stage = 0; stage < STAGE_COUNT; ++stage)
+    {
+        stageBuckets_[stage][bucketFor(metrics.stageNanos[stage])]++;
+    }
+    totalBuckets_[bucketFor(metrics.totalNanos)]++;
+}
+
+void MetricsAggregate::writeHistogram(std::ostream &out, const uint64_t (&buckets)[BUCKETS])
+{
+    // Trailing empty buckets are left out
+    int used = BUCKETS;
+    while (used > 1 && buckets[used - 1] == 0)
+    {
+        used--;
+    }
+
+    out << "[";
+    for (int i = 0; i < used; ++i)
+    {
+        out << (i ? ", " : "") << buckets[i];
+    }
+    out << "]";
+}
+
+void MetricsAggregate::writeJson(std::ostream &out) const
+{
+    out << "{\"conversions\": " << conversions_ << ", \"counters\": {";
+    writeCounters(out, counters_);
+    out << "}, \"histograms_ms\": {\"total\": ";
+    writeHistogram(out, totalBuckets_);
+    for (int stage = 0; stage < STAGE_COUNT; ++stage)
+    {
+        out << ", \"" << metricStageName(static_cast<MetricStage>(stage)) << "\": ";
+        writeHistogram(out, stageBuckets_[stage]);
+    }
+    out << "}}";
+}
@@ -0,0 +1,567 @@
+#include "PdfEmitter.h"
+#include "Diagnostics.h"
+#include "FontCache.h"
+#include "FontSubsetter.h"
+#include "HaruFonts.h"
+#include "HaruImages.h"
+#include "HaruPages.h"
+#include "Hash.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include <errno.h>
+#include <hpdf.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <atomic>
+#include <cmath>
+#include <initializer_list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Marks the glyphs each face draws in runs [first, end)
+static void markUsedGlyphs(const Layout &layout, const FontCache &fontCache, uint32_t first, uint32_t end,
+                           std::vector<uint8_t> usedGlyphs[FONT_COUNT])
+{
+    for (uint32_t i = first; i < end; ++i)
+    {
+        const GlyphRun &run = layout.runs[i];
+        const FontMetrics &metrics = fontCache.metrics(static_cast<FontId>(run.fontId));
+        std::vector<uint8_t> &used = usedGlyphs[run.fontId];
+        std::string_view text(layout.text.data() + run.textOffset, run.textLength);
+        for (size_t pos = 0; pos < text.size();)
+        {
+            uint16_t glyph = metrics.glyphIndex(decodeUtf8(text, pos));
+            if (glyph < used.size())
+                used[glyph] = 1;
+        }
+    }
+}
+
+// Marks the glyphs each face draws anywhere in the layout. Every character is
+// decoded and looked up, so long documents are scanned in page ranges on
+// several cores and the per-range sets merged.
+static void collectUsedGlyphs(const Layout &layout, const FontCache &fontCache,
+                              std::vector<uint8_t> usedGlyphs[FONT_COUNT])
+{
+    for (int id = 0; id < FONT_COUNT; ++id)
+    {
+        usedGlyphs[id].assign(fontCache.metrics(static_cast<FontId>(id)).glyphCount(), 0);
+    }
+
+    std::mutex mergeMutex;
+    parallelFor(layout.pages.size(), 16, [&](size_t begin, size_t end) {
+        uint32_t first = layout.pages[begin].firstRun;
+        uint32_t last = layout.pages[end - 1].firstRun + layout.pages[end - 1].runCount;
+        if (begin == 0 && end == layout.pages.size())
+        {
+            markUsedGlyphs(layout, fontCache, first, last, usedGlyphs);
+            return;
+        }
+
+        std::vector<uint8_t> local[FONT_COUNT];
+        for (int id = 0; id < FONT_COUNT; ++id)
+        {
+            local[id].assign(usedGlyphs[id].size(), 0);
+        }
+        markUsedGlyphs(layout, fontCache, first, last, local);
+
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        for (int id = 0; id < FONT_COUNT; ++id)
+        {
+            for (size_t glyph = 0; glyph < local[id].size(); ++glyph)
+                usedGlyphs[id][glyph] |= local[id][glyph];
+        }
+    });
+}
+
+// Creates the document and registers the four faces, returns nullptr on failure.
+// Each face is embedded as a subset holding only the glyphs the layout uses.
+static HPDF_Doc createDocument(const Layout &layout, HPDF_Font fonts[FONT_COUNT])
+{
+    HPDF_Doc pdf = HPDF_New(NULL, NULL);
+
+    if (!pdf)
+    {
+        reportError(CONVERT_PDF_FAILED, "Failed to create PDF object.");
+        return nullptr;
+    }
+
+    // Fonts, ToUnicode maps and decoded images are deflated on save. Page
+    // contents come in deflated already, see emitDocument.
+    HPDF_SetCompressionMode(pdf, HPDF_COMP_ALL);
+    HPDF_UseUTFEncodings(pdf);
+    HPDF_SetCurrentEncoder(pdf, "UTF-8");
+
+    // Register fonts from the process-wide cache, nothing is read from disk here
+    const FontCache *fontCache = FontCache::instance();
+    if (!fontCache)
+    {
+        reportError(CONVERT_FONTS_UNAVAILABLE, "No fonts in " + fontDirectory());
+        HPDF_Free(pdf);
+        return nullptr;
+    }
+
+    std::vector<uint8_t> usedGlyphs[FONT_COUNT];
+    collectUsedGlyphs(layout, *fontCache, usedGlyphs);
+
+    // The faces are subset independently, only registering them touches the document.
+    // libharu copies the data, so a subset only has to live until it is registered.
+    std::string subsets[FONT_COUNT];
+    parallelFor(FONT_COUNT, 1, [&](size_t begin, size_t end) {
+        for (size_t id = begin; id < end; ++id)
+        {
+            subsets[id] = subsetTrueTypeFont(fontCache->fontData(static_cast<FontId>(id)), usedGlyphs[id]);
+        }
+    });
+
+    for (int id = 0; id < FONT_COUNT; ++id)
+    {
+        // Fall back to the whole font if it couldn't be subset
+        std::string_view fontData = fontCache->fontData(static_cast<FontId>(id));
+        const std::string &subset = subsets[id];
+        if (!subset.empty())
+        {
+            fontData = subset;
+        }
+
+        const char *fontName = loadTTFontFromMemory(pdf, fontData, true);
+        fonts[id] = fontName ? HPDF_GetFont(pdf, fontName, "UTF-8") : nullptr;
+
+        if (!fonts[id])
+        {
+            reportError(CONVERT_PDF_FAILED, "Failed to load TrueType font " + fontFilePath(static_cast<FontId>(id)));
+            HPDF_Free(pdf);
+            return nullptr;
+        }
+    }
+
+    return pdf;
+}
+
+struct ContentHash
+{
+    size_t operator()(const Hash128 &key) const { return static_cast<size_t>(key.low); }
+};
+
+// Embeds every image of the layout once, by ID and by content, so a picture
+// drawn again or stored under two names costs one XObject. Images that can't
+// be read or embedded are null and not drawn.
+static std::vector<HPDF_Image> embedImages(HPDF_Doc pdf, const Layout &layout, const ImageSource &source)
+{
+    std::vector<HPDF_Image> images(layout.imageParts.size(), nullptr);
+    if (!source)
+    {
+        return images;
+    }
+
+    std::unordered_map<Hash128, HPDF_Image, ContentHash> embedded;
+    std::string data; // reused, every image is copied into the document
+    for (size_t id = 0; id < images.size(); ++id)
+    {
+        const std::string &part = layout.imageParts[id];
+        if (!source(part, data))
+        {
+            reportWarning("Failed to read image " + part);
+            continue;
+        }
+
+        Hash128 hash = hash128(data);
+        auto it = embedded.find(hash);
+        if (it != embedded.end())
+        {
+            images[id] = it->second;
+            continue;
+        }
+
+        images[id] = loadImageFromMemory(pdf, data);
+        if (!images[id])
+        {
+            reportWarning("Unsupported or damaged image " + part);
+            continue;
+        }
+        embedded.emplace(hash, images[id]);
+        countMetric(COUNTER_IMAGES_EMBEDDED, 1);
+    }
+    return images;
+}
+
+// Appends value with at most three decimals, PDF numbers have no exponent
+static void appendNumber(std::string &out, float value)
+{
+    long scaled = std::lround(value * 1000.0);
+    if (scaled < 0)
+    {
+        out += '-';
+        scaled = -scaled;
+    }
+
+    char digits[24];
+    int count = 0;
+    long whole = scaled / 1000;
+    do
+    {
+        digits[count++] = static_cast<char>('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+    while (count > 0)
+    {
+        out += digits[--count];
+    }
+
+    int fraction = static_cast<int>(scaled % 1000);
+    if (fraction > 0)
+    {
+        char decimals[3] = {static_cast<char>('0' + fraction / 100), static_cast<char>('0' + fraction / 10 % 10),
+                            static_cast<char>('0' + fraction % 10)};
+        int length = 3;
+        while (decimals[length - 1] == '0')
+        {
+            length--;
+        }
+        out += '.';
+        out.append(decimals, length);
+    }
+}
+
+static void appendOperator(std::string &out, std::initializer_list<float> operands, const char *op)
+{
+    for (float operand : operands)
+    {
+        appendNumber(out, operand);
+        out += ' ';
+    }
+    out += op;
+    out += '\n';
+}
+
+// The codes HPDF_Page_ShowText writes for a font with libharu's UTF-8
+// encoder: each character's UTF-16 value, big-endian, which the font's
+// CIDToGIDMap maps to its glyph. Characters beyond the BMP have none.
+static void appendText(std::string &out, std::string_view text)
+{
+    static const char HEX[] = "0123456789ABCDEF";
+    out += '<';
+    for (size_t pos = 0; pos < text.size();)
+    {
+        uint32_t codepoint = decodeUtf8(text, pos);
+        if (codepoint > 0xFFFF)
+        {
+            codepoint = 0;
+        }
+        out += HEX[codepoint >> 12];
+        out += HEX[(codepoint >> 8) & 0xF];
+        out += HEX[(codepoint >> 4) & 0xF];
+        out += HEX[codepoint & 0xF];
+    }
+    out += "> Tj\n";
+}
+
+// Names a page's operators use for the resources it draws
+struct PageResources
+{
+    HPDF_Page page = nullptr;
+    const char *fonts[FONT_COUNT] = {};
+    std::vector<const char *> images; // by placed image of the page, null if it isn't drawn
+};
+
+// Adds the page and registers what it draws with its resources. This is the
+// part that changes the document, so it runs on the document's thread.
+static PageResources addPage(HPDF_Doc pdf, const Layout &layout, const LayoutPage &layoutPage,
+                             HPDF_Font fonts[FONT_COUNT], const std::vector<HPDF_Image> &images)
+{
+    PageResources resources;
+    resources.page = HPDF_AddPage(pdf);
+    HPDF_Page_SetSize(resources.page, HPDF_PAGE_SIZE_A4, HPDF_PAGE_PORTRAIT);
+
+    for (uint32_t i = layoutPage.firstRun; i < layoutPage.firstRun + layoutPage.runCount; ++i)
+    {
+        uint8_t fontId = layout.runs[i].fontId;
+        if (!resources.fonts[fontId])
+        {
+            resources.fonts[fontId] = pageFontName(resources.page, fonts[fontId]);
+        }
+    }
+
+    resources.images.assign(layoutPage.imageCount, nullptr);
+    for (uint32_t i = 0; i < layoutPage.imageCount; ++i)
+    {
+        HPDF_Image image = images[layout.images[layoutPage.firstImage + i].imageId];
+        if (image)
+        {
+            resources.images[i] = pageImageName(resources.page, image);
+        }
+    }
+    return resources;
+}
+
+// Formats the page's operators into out, what HPDF_Page_DrawImage,
+// HPDF_Page_ShowText and the other HPDF_Page_* calls would write
+static void formatPage(const Layout &layout, const LayoutPage &layoutPage, const PageResources &resources,
+                       std::string &out)
+{
+    for (uint32_t i = 0; i < layoutPage.imageCount; ++i)
+    {
+        const PlacedImage &placed = layout.images[layoutPage.firstImage + i];
+        if (resources.images[i])
+        {
+            out += "q\n";
+            appendOperator(out, {placed.width, 0, 0, placed.height, placed.x, placed.y}, "cm");
+            out += '/';
+            out += resources.images[i];
+            out += " Do\nQ\n";
+        }
+    }
+
+    // Table borders
+    if (layoutPage.ruleCount > 0)
+    {
+        out += "0 0 0 RG\n0.5 w\n"; // Black color for borders
+
+        for (uint32_t i = layoutPage.firstRule; i < layoutPage.firstRule + layoutPage.ruleCount; ++i)
+        {
+            const Rule &rule = layout.rules[i];
+            appendOperator(out, {rule.x1, rule.y1}, "m");
+            appendOperator(out, {rule.x2, rule.y2}, "l");
+            out += "S\n";
+        }
+    }
+
+    // Text: one text object per line. Within a line each run is positioned
+    // relative to the previous one, and font and color are only set when they change.
+    bool haveColor = false;
+    float r = 0, g = 0, b = 0;
+    uint32_t end = layoutPage.firstRun + layoutPage.runCount;
+    uint32_t i = layoutPage.firstRun;
+    while (i < end)
+    {
+        float lineY = layout.runs[i].y;
+        int currentFont = -1;
+        float currentSize = 0;
+        float textX = 0, textY = 0;
+
+        out += "BT\n";
+        for (; i < end && layout.runs[i].y == lineY; ++i)
+        {
+            const GlyphRun &run = layout.runs[i];
+
+            if (!haveColor || run.r != r || run.g != g || run.b != b)
+            {
+                r = run.r;
+                g = run.g;
+                b = run.b;
+                haveColor = true;
+                appendOperator(out, {r, g, b}, "rg");
+            }
+            if (run.fontId != currentFont || run.fontSize != currentSize)
+            {
+                currentFont = run.fontId;
+                currentSize = run.fontSize;
+                out += '/';
+                out += resources.fonts[run.fontId];
+                out += ' ';
+                appendOperator(out, {run.fontSize}, "Tf");
+            }
+
+            appendOperator(out, {run.x - textX, run.y - textY}, "Td");
+            textX = run.x;
+            textY = run.y;
+            appendText(out, std::string_view(layout.text.data() + run.textOffset, run.textLength));
+        }
+        out += "ET\n";
+    }
+}
+
+static bool deflateInto(const std::string &data, std::string &deflated)
+{
+    uLongf size = compressBound(static_cast<uLong>(data.size()));
+    deflated.resize(size);
+    if (compress2(reinterpret_cast<Bytef *>(&deflated[0]), &size, reinterpret_cast<const Bytef *>(data.data()),
+                  static_cast<uLong>(data.size()), Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        return false;
+    }
+    deflated.resize(size);
+    return true;
+}
+
+// Builds the whole document, returns nullptr on failure. The caller saves and frees it.
+static HPDF_Doc emitDocument(const Layout &layout, const ImageSource &imageSource)
+{
+    StageTimer emitTimer(STAGE_EMIT);
+    HPDF_Font fonts[FONT_COUNT];
+    HPDF_Doc pdf = createDocument(layout, fonts);
+    if (!pdf)
+    {
+        return nullptr;
+    }
+
+    std::vector<HPDF_Image> images = embedImages(pdf, layout, imageSource);
+    std::vector<PageResources> pages;
+    pages.reserve(layout.pages.size());
+    for (const LayoutPage &layoutPage : layout.pages)
+    {
+        pages.push_back(addPage(pdf, layout, layoutPage, fonts, images));
+    }
+
+    // Formatting and deflating the operators is most of the emit time and
+    // touches nothing in the document, so pages are done on several cores.
+    // libharu would deflate them one after another while saving.
+    std::vector<std::string> contents(pages.size());
+    std::atomic<bool> failed{false};
+    parallelFor(pages.size(), 4, [&](size_t begin, size_t end) {
+        std::string operators; // reused by the pages of the chunk
+        for (size_t page = begin; page < end; ++page)
+        {
+            operators.clear();
+            formatPage(layout, layout.pages[page], pages[page], operators);
+            if (!deflateInto(operators, contents[page]))
+            {
+                failed = true;
+            }
+        }
+    });
+
+    for (size_t page = 0; page < pages.size() && !failed; ++page)
+    {
+        if (!setPageContents(pages[page].page, contents[page]))
+        {
+            failed = true;
+        }
+        std::string().swap(contents[page]); // libharu holds a copy now
+    }
+    if (failed)
+    {
+        reportError(CONVERT_PDF_FAILED, "Failed to write page contents.");
+        HPDF_Free(pdf);
+        return nullptr;
+    }
+
+    countMetric(COUNTER_PAGES_EMITTED, layout.pages.size());
+    return pdf;
+}
+
+bool writePdf(const Layout &layout, const std::string &outputPdfPath, const ImageSource &images)
+{
+    HPDF_Doc pdf = emitDocument(layout, images);
+    if (!pdf)
+    {
+        return false;
+    }
+
+    StageTimer saveTimer(STAGE_SAVE);
+    bool saved = HPDF_SaveToFile(pdf, outputPdfPath.c_str()) == HPDF_OK;
+    saveTimer.stop();
+    if (!saved)
+    {
+        reportError(CONVERT_IO_ERROR, "Failed to save PDF to " + outputPdfPath);
+    }
+
+    HPDF_Free(pdf);
+    return saved;
+}
+
+// libharu can only serialize a whole document into its own memory stream, so
+// the stream is filled once and then handed to sink a chunk at a time. When
+// sink appends to reserve, room for the whole file is made there up front.
+static bool saveToSink(HPDF_Doc pdf, const PdfSink &sink, std::string *reserve)
+{
+    if (HPDF_SaveToStream(pdf) != HPDF_OK)
+    {
+        return false;
+    }
+    if (reserve)
+    {
+        reserve->reserve(HPDF_GetStreamSize(pdf));
+    }
+    HPDF_ResetStream(pdf);
+
+    std::vector<HPDF_BYTE> chunk(64 * 1024);
+    while (true)
+    {
+        HPDF_UINT32 read = static_cast<HPDF_UINT32>(chunk.size());
+
+        // A read that reaches the end of the stream reports HPDF_STREAM_EOF
+        HPDF_STATUS status = HPDF_ReadFromStream(pdf, chunk.data(), &read);
+        if (status != HPDF_OK && status != HPDF_STREAM_EOF)
+        {
+            return false;
+        }
+        if (read > 0 && !sink(reinterpret_cast<const char *>(chunk.data()), read))
+        {
+            return false;
+        }
+        if (status == HPDF_STREAM_EOF || read == 0)
+        {
+            return true;
+        }
+    }
+}
+
+static bool emitToSink(const Layout &layout, const PdfSink &sink, const ImageSource &images, std::string *reserve)
+{
+    HPDF_Doc pdf = emitDocument(layout, images);
+    if (!pdf)
+    {
+        return false;
+    }
+
+    StageTimer saveTimer(STAGE_SAVE);
+    bool saved = saveToSink(pdf, sink, reserve);
+    saveTimer.stop();
+    if (!saved)
+    {
+        reportError(CONVERT_PDF_FAILED, "Failed to write PDF output.");
+    }
+
+    HPDF_Free(pdf);
+    return saved;
+}
+
+bool writePdfToSink(const Layout &layout, const PdfSink &sink, const ImageSource &images)
+{
+    return emitToSink(layout, sink, images, nullptr);
+}
+
+bool writePdfToMemory(const Layout &layout, std::string &pdfBytes, const ImageSource &images)
+{
+    pdfBytes.clear();
+    auto append = [&pdfBytes](const char *data, size_t size) {
+        pdfBytes.append(data, size);
+        return true;
+    };
+    bool saved = emitToSink(layout, append, images, &pdfBytes);
+    if (!saved)
+    {
+        pdfBytes.clear();
+    }
+    return saved;
+}
+
+bool writePdfToFd(const Layout &layout, int fd, const ImageSource &images)
+{
+    auto writeAll = [fd](const char *data, size_t size) {
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+            {
+                reportError(CONVERT_IO_ERROR, std::string("Failed to write PDF output: ") + strerror(errno));
+                return false;
+            }
+            // Nothing written without an error: errno is stale, don't report it
+            if (n == 0)
+            {
+                reportError(CONVERT_IO_ERROR, "Failed to write PDF output: the descriptor accepted no data");
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    };
+    return writePdfToSink(layout, writeAll, images);
+}
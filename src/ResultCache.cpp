@@ -0,0 +1,224 @@
+#include "ResultCache.h"
+#include "BuildId.h"
+#include "Diagnostics.h"
+#include "FontCache.h"
+#include "Hash.h"
+#include <boost/filesystem.hpp>
+#include <hpdf.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifndef DOCX2PDF_VERSION
+#define DOCX2PDF_VERSION "unknown"
+#endif
+
+namespace fs = boost::filesystem;
+
+// Must be bumped whenever the output of a conversion changes, and whenever
+// the layout of the cache directory does. The build id already tells builds
+// from different sources apart, this covers everything it can't see: the
+// same sources built with other compiler flags, or a fix that only lands in
+// an installed copy of the tree.
+static const char CACHE_FORMAT[] = "2";
+
+ResultCache::ResultCache(const std::string &directory, uint64_t maxBytes) : directory_(directory), maxBytes_(maxBytes)
+{
+}
+
+bool ResultCache::open()
+{
+    boost::system::error_code ec;
+    fs::create_directories(directory_, ec);
+    if (ec)
+    {
+        reportError(CONVERT_IO_ERROR, "Failed to create cache directory " + directory_ + ": " + ec.message());
+        return false;
+    }
+
+    // Seed the LRU order from the modification times, oldest last
+    std::vector<std::pair<std::time_t, std::pair<std::string, uint64_t>>> found;
+    for (fs::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec))
+    {
+        const fs::path &path = it->path();
+
+        // Left behind by a process that died while storing
+        if (path.filename().string().find(".pdf.tmp") != std::string::npos)
+        {
+            fs::remove(path, ec);
+            ec.clear();
+            continue;
+        }
+        if (path.extension() != ".pdf" || !fs::is_regular_file(path, ec))
+            continue;
+
+        uint64_t size = fs::file_size(path, ec);
+        std::time_t used = fs::last_write_time(path, ec);
+        if (!ec)
+            found.push_back({used, {path.stem().string(), size}});
+    }
+    std::sort(found.begin(), found.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &item : found)
+    {
+        const std::string &key = item.second.first;
+        recency_.push_back(key);
+        entries_[key] = Entry{item.second.second, std::prev(recency_.end())};
+        stats_.bytes += item.second.second;
+    }
+    stats_.entries = entries_.size();
+    evictLocked();
+    return true;
+}
+
+std::string ResultCache::keyFor(std::string_view docxBytes)
+{
+    // Everything but the document that decides the PDF, hashed once
+    static const uint64_t seed = []() {
+        std::string build = std::string(DOCX2PDF_VERSION) + '\0' + DOCX2PDF_BUILD_ID + '\0' + CACHE_FORMAT +
+                            '\0' + HPDF_VERSION_TEXT + '\0' + zlibVersion();
+        const FontCache *fonts = FontCache::instance();
+        Hash128 hash = hash128(build, fonts ? fonts->fingerprint() : 0);
+        return hash.low ^ hash.high;
+    }();
+    Hash128 hash = hash128(docxBytes, seed);
+
+    std::ostringstream key;
+    key << std::hex << std::setfill('0') << std::setw(16) << hash.low << std::setw(16) << hash.high;
+    return key.str();
+}
+
+std::string ResultCache::pathFor(const std::string &key) const
+{
+    return (fs::path(directory_) / (key + ".pdf")).string();
+}
+
+bool ResultCache::lookup(const std::string &key, std::string &pdfBytes)
+{
+    bool indexed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        indexed = it != entries_.end();
+        if (indexed)
+            recency_.splice(recency_.begin(), recency_, it->second.recency);
+    }
+
+    std::string path = pathFor(key);
+    bool found = false;
+    if (indexed)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream buffer;
+        found = in.is_open() && (buffer << in.rdbuf());
+        if (found)
+            pdfBytes = buffer.str();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!found)
+        {
+            stats_.misses++;
+            return false;
+        }
+        stats_.hits++;
+    }
+
+    // The next run orders the entries by this
+    boost::system::error_code ec;
+    fs::last_write_time(path, std::time(nullptr), ec);
+    return true;
+}
+
+void ResultCache::store(const std::string &key, std::string_view pdfBytes)
+{
+    if (pdfBytes.size() > maxBytes_)
+    {
+        return;
+    }
+
+    // Written under a temporary name and renamed, so a reader never sees half a file
+    std::string tempPath;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tempPath = pathFor(key) + ".tmp" + std::to_string(::getpid()) + "." + std::to_string(tempCounter_++);
+    }
+
+    std::ofstream out(tempPath, std::ios::binary);
+    if (!out.write(pdfBytes.data(), pdfBytes.size()) || (out.close(), !out))
+    {
+        reportWarning("Failed to write cache entry " + tempPath);
+        ::remove(tempPath.c_str());
+        return;
+    }
+
+    boost::system::error_code ec;
+    fs::rename(tempPath, pathFor(key), ec);
+    if (ec)
+    {
+        reportWarning("Failed to store cache entry " + key + ": " + ec.message());
+        ::remove(tempPath.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+    {
+        // Converted twice concurrently, the file was just replaced
+        stats_.bytes -= it->second.size;
+        it->second.size = pdfBytes.size();
+        recency_.splice(recency_.begin(), recency_, it->second.recency);
+    }
+    else
+    {
+        recency_.push_front(key);
+        entries_[key] = Entry{pdfBytes.size(), recency_.begin()};
+    }
+    stats_.bytes += pdfBytes.size();
+    stats_.stores++;
+    evictLocked();
+    stats_.entries = entries_.size();
+}
+
+void ResultCache::evictLocked()
+{
+    while (stats_.bytes > maxBytes_ && !recency_.empty())
+    {
+        const std::string &key = recency_.back();
+        auto it = entries_.find(key);
+
+        boost::system::error_code ec;
+        fs::remove(pathFor(key), ec);
+        stats_.bytes -= it->second.size;
+        stats_.evictions++;
+
+        entries_.erase(it);
+        recency_.pop_back();
+    }
+    stats_.entries = entries_.size();
+}
+
+ResultCache::Stats ResultCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ResultCache::printStats(std::ostream &out) const
+{
+    Stats s = stats();
+    uint64_t lookups = s.hits + s.misses;
+    out << std::fixed << std::setprecision(1) << "Cache: " << s.hits << " hits, " << s.misses << " misses ("
+        << (lookups ? 100.0 * s.hits / lookups : 0.0) << "% hit rate), " << s.stores << " stored, " << s.evictions
+        << " evicted, " << s.entries << " entries using " << s.bytes / (1024.0 * 1024.0) << " of "
+        << maxBytes_ / (1024.0 * 1024.0) << " MB" << std::endl;
+}
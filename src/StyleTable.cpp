@@ -0,0 +1,432 @@
+#include "StyleTable.h"
+#include "Diagnostics.h"
+#include "Hash.h"
+#include <tinyxml2.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace tinyxml2;
+
+// Word numbers list items up to 32767
+static const int MAX_LIST_NUMBER = 32767;
+
+// Used when docDefaults doesn't say, the sizes the converter always used
+static const int DEFAULT_HALF_POINTS = 24;
+
+void RunProps::overlay(const RunProps &over)
+{
+    if (over.bold >= 0)
+        bold = over.bold;
+    if (over.italic >= 0)
+        italic = over.italic;
+    if (over.color >= 0)
+        color = over.color;
+    if (over.halfPoints > 0)
+        halfPoints = over.halfPoints;
+}
+
+// On/off properties such as <w:b/>: present means on unless w:val turns it off
+static int8_t readToggle(const XMLElement *element)
+{
+    const char *val = element->Attribute("w:val");
+    if (!val)
+        return 1;
+    return (strcmp(val, "0") == 0 || strcmp(val, "false") == 0 || strcmp(val, "off") == 0) ? 0 : 1;
+}
+
+// Exactly six hex digits as 0xRRGGBB, -1 for anything else ("auto")
+static int32_t parseHexColor(const char *text)
+{
+    int32_t value = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        char c = text[i];
+        char lower = static_cast<char>(c | 0x20);
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (lower >= 'a' && lower <= 'f')
+            digit = lower - 'a' + 10;
+        else
+            return -1; // also stops at the terminator of a short value
+        value = value << 4 | digit;
+    }
+    return text[6] == '\0' ? value : -1;
+}
+
+int32_t parseUnsigned(const char *text)
+{
+    int32_t value = 0;
+    for (; *text >= '0' && *text <= '9'; ++text)
+    {
+        value = std::min(value * 10 + (*text - '0'), 100000000);
+    }
+    return value;
+}
+
+RunProps readRunProps(const XMLElement *rPr, const char **rStyle)
+{
+    RunProps props;
+    if (rStyle)
+        *rStyle = nullptr;
+    if (!rPr)
+        return props;
+
+    // One pass over the children instead of a FirstChildElement scan per property
+    for (const XMLElement *child = rPr->FirstChildElement(); child; child = child->NextSiblingElement())
+    {
+        const char *name = child->Name();
+        if (name[0] != 'w' || name[1] != ':')
+            continue;
+        name += 2;
+
+        if (strcmp(name, "b") == 0)
+        {
+            props.bold = readToggle(child);
+        }
+        else if (strcmp(name, "i") == 0)
+        {
+            props.italic = readToggle(child);
+        }
+        else if (strcmp(name, "color") == 0)
+        {
+            const char *rgb = child->Attribute("w:val");
+            props.color = rgb ? parseHexColor(rgb) : -1;
+        }
+        else if (strcmp(name, "sz") == 0)
+        {
+            const char *halfPoints = child->Attribute("w:val");
+            props.halfPoints = halfPoints ? parseUnsigned(halfPoints) : 0;
+        }
+        else if (rStyle && strcmp(name, "rStyle") == 0)
+        {
+            *rStyle = child->Attribute("w:val");
+        }
+    }
+    return props;
+}
+
+// w:numPr inside a w:pPr, present tells whether there is one. numId is -1
+// when it only sets the level.
+NumberingRef readNumPr(const XMLElement *pPr, bool &present)
+{
+    NumberingRef ref;
+    present = false;
+    const XMLElement *numPr = pPr ? pPr->FirstChildElement("w:numPr") : nullptr;
+    if (!numPr)
+        return ref;
+
+    present = true;
+    const XMLElement *numId = numPr->FirstChildElement("w:numId");
+    const XMLElement *ilvl = numPr->FirstChildElement("w:ilvl");
+    ref.numId = numId && numId->Attribute("w:val") ? parseUnsigned(numId->Attribute("w:val")) : -1;
+    ref.level = ilvl && ilvl->Attribute("w:val") ? parseUnsigned(ilvl->Attribute("w:val")) : 0;
+    return ref;
+}
+
+StyleTable::StyleTable()
+{
+    Style defaults;
+    defaults.runProps.bold = 0;
+    defaults.runProps.italic = 0;
+    defaults.runProps.halfPoints = DEFAULT_HALF_POINTS;
+    styles_.push_back(defaults);
+}
+
+bool StyleTable::load(std::string_view stylesXml, std::string_view numberingXml)
+{
+    Hash128 stylesHash = hash128(stylesXml);
+    Hash128 numberingHash = hash128(numberingXml, stylesHash.low);
+    fingerprint_ = numberingHash.low ^ numberingHash.high;
+
+    if (!stylesXml.empty())
+        loadStyles(stylesXml);
+    if (!numberingXml.empty())
+        loadNumbering(numberingXml);
+    return true;
+}
+
+void StyleTable::loadStyles(std::string_view stylesXml)
+{
+    XMLDocument doc;
+    if (doc.Parse(stylesXml.data(), stylesXml.size()) != XML_SUCCESS || !doc.RootElement())
+    {
+        reportWarning("Failed to parse styles.xml, using default formatting.");
+        return;
+    }
+    XMLElement *root = doc.RootElement();
+
+    // docDefaults sit under every paragraph style
+    XMLElement *rPrDefault = root->FirstChildElement("w:docDefaults");
+    rPrDefault = rPrDefault ? rPrDefault->FirstChildElement("w:rPrDefault") : nullptr;
+    if (rPrDefault)
+    {
+        styles_[0].runProps.overlay(readRunProps(rPrDefault->FirstChildElement("w:rPr")));
+    }
+
+    // First pass: every style as written, with the ID it is based on
+    struct Raw
+    {
+        bool paragraph;
+        std::string basedOn;
+        RunProps runProps;
+        NumberingRef numbering;
+        bool hasNumbering;
+    };
+    std::vector<Raw> raw;
+    for (XMLElement *style = root->FirstChildElement("w:style"); style; style = style->NextSiblingElement("w:style"))
+    {
+        const char *type = style->Attribute("w:type");
+        const char *id = style->Attribute("w:styleId");
+        bool paragraph = type && strcmp(type, "paragraph") == 0;
+        if (!id || !type || (!paragraph && strcmp(type, "character") != 0))
+            continue;
+
+        Raw entry;
+        entry.paragraph = paragraph;
+        const XMLElement *basedOn = style->FirstChildElement("w:basedOn");
+        if (basedOn && basedOn->Attribute("w:val"))
+            entry.basedOn = basedOn->Attribute("w:val");
+        entry.runProps = readRunProps(style->FirstChildElement("w:rPr"));
+        entry.numbering = readNumPr(style->FirstChildElement("w:pPr"), entry.hasNumbering);
+
+        ids_.push_back(id);
+        raw.push_back(entry);
+        if (paragraph && style->BoolAttribute("w:default"))
+            defaultParagraph_ = static_cast<uint16_t>(raw.size());
+    }
+
+    // ids_ is complete, the maps can point into it. Style i is stored at i + 1.
+    for (size_t i = 0; i < raw.size(); ++i)
+    {
+        (raw[i].paragraph ? paragraphIds_ : characterIds_)[ids_[i]] = static_cast<uint16_t>(i + 1);
+    }
+
+    // Second pass: flatten each basedOn chain, resolved entries are reused.
+    // A chain that loops or is absurdly deep is cut off.
+    styles_.resize(raw.size() + 1);
+    std::vector<uint8_t> state(raw.size(), 0); // 0 new, 1 in progress, 2 done
+    std::vector<size_t> chain;
+    for (size_t i = 0; i < raw.size(); ++i)
+    {
+        chain.clear();
+        for (size_t at = i; state[at] == 0 && chain.size() < 64;)
+        {
+            state[at] = 1;
+            chain.push_back(at);
+            const auto &ids = raw[at].paragraph ? paragraphIds_ : characterIds_;
+            auto parent = ids.find(raw[at].basedOn);
+            if (raw[at].basedOn.empty() || parent == ids.end())
+                break;
+            at = parent->second - 1;
+        }
+
+        // Apply from the root of the chain down
+        for (size_t n = chain.size(); n-- > 0;)
+        {
+            size_t at = chain[n];
+            Style resolved;
+            if (raw[at].paragraph)
+                resolved = styles_[0];
+            const auto &ids = raw[at].paragraph ? paragraphIds_ : characterIds_;
+            auto parent = raw[at].basedOn.empty() ? ids.end() : ids.find(raw[at].basedOn);
+            if (parent != ids.end() && state[parent->second - 1] == 2)
+                resolved = styles_[parent->second];
+
+            resolved.runProps.overlay(raw[at].runProps);
+            if (raw[at].hasNumbering)
+            {
+                // A numPr with only a level keeps the list of the style it is based on
+                if (raw[at].numbering.numId >= 0)
+                    resolved.numbering.numId = raw[at].numbering.numId;
+                resolved.numbering.level = raw[at].numbering.level;
+            }
+            numberedStyles_ = numberedStyles_ || resolved.numbering.numId > 0;
+            styles_[at + 1] = resolved;
+            state[at] = 2;
+        }
+    }
+}
+
+// A w:start or w:startOverride, clamped to the numbers Word can show
+static int readStart(const XMLElement *start)
+{
+    return std::clamp(start->IntAttribute("w:val", 1), 0, MAX_LIST_NUMBER);
+}
+
+void StyleTable::loadNumbering(std::string_view numberingXml)
+{
+    XMLDocument doc;
+    if (doc.Parse(numberingXml.data(), numberingXml.size()) != XML_SUCCESS || !doc.RootElement())
+    {
+        reportWarning("Failed to parse numbering.xml, lists are drawn without markers.");
+        return;
+    }
+    XMLElement *root = doc.RootElement();
+
+    std::unordered_map<int, std::array<Level, MAX_LEVELS>> abstracts;
+    for (XMLElement *abstract = root->FirstChildElement("w:abstractNum"); abstract;
+         abstract = abstract->NextSiblingElement("w:abstractNum"))
+    {
+        std::array<Level, MAX_LEVELS> &levels = abstracts[abstract->IntAttribute("w:abstractNumId")];
+        for (XMLElement *lvl = abstract->FirstChildElement("w:lvl"); lvl; lvl = lvl->NextSiblingElement("w:lvl"))
+        {
+            int index = lvl->IntAttribute("w:ilvl");
+            if (index < 0 || index >= MAX_LEVELS)
+                continue;
+
+            Level &level = levels[index];
+            if (const XMLElement *start = lvl->FirstChildElement("w:start"))
+                level.start = readStart(start);
+            if (const XMLElement *format = lvl->FirstChildElement("w:numFmt"))
+                level.format = format->Attribute("w:val") ? format->Attribute("w:val") : "decimal";
+            if (const XMLElement *text = lvl->FirstChildElement("w:lvlText"))
+                level.text = text->Attribute("w:val") ? text->Attribute("w:val") : "";
+        }
+    }
+
+    for (XMLElement *num = root->FirstChildElement("w:num"); num; num = num->NextSiblingElement("w:num"))
+    {
+        const XMLElement *abstractId = num->FirstChildElement("w:abstractNumId");
+        auto abstract = abstractId ? abstracts.find(abstractId->IntAttribute("w:val")) : abstracts.end();
+        if (abstract == abstracts.end())
+            continue;
+
+        std::array<Level, MAX_LEVELS> levels = abstract->second;
+        for (const XMLElement *lvlOverride = num->FirstChildElement("w:lvlOverride"); lvlOverride;
+             lvlOverride = lvlOverride->NextSiblingElement("w:lvlOverride"))
+        {
+            int index = lvlOverride->IntAttribute("w:ilvl");
+            const XMLElement *start = lvlOverride->FirstChildElement("w:startOverride");
+            if (start && index >= 0 && index < MAX_LEVELS)
+                levels[index].start = readStart(start);
+        }
+        lists_[num->IntAttribute("w:numId")] = levels;
+    }
+}
+
+uint16_t StyleTable::paragraphStyle(const char *styleId) const
+{
+    if (!styleId)
+        return defaultParagraph_;
+    auto it = paragraphIds_.find(styleId);
+    return it != paragraphIds_.end() ? it->second : defaultParagraph_;
+}
+
+uint16_t StyleTable::characterStyle(const char *styleId) const
+{
+    if (!styleId)
+        return NO_STYLE;
+    auto it = characterIds_.find(styleId);
+    return it != characterIds_.end() ? it->second : NO_STYLE;
+}
+
+bool StyleTable::mayBeNumbered(std::string_view elementXml) const
+{
+    if (lists_.empty())
+        return false;
+    return elementXml.find("w:numPr") != std::string_view::npos ||
+           (numberedStyles_ && (elementXml.find("w:pStyle") != std::string_view::npos ||
+                                numbering(defaultParagraph_).numId > 0));
+}
+
+const std::array<StyleTable::Level, StyleTable::MAX_LEVELS> *StyleTable::levels(int numId) const
+{
+    auto it = lists_.find(numId);
+    return it != lists_.end() ? &it->second : nullptr;
+}
+
+static std::string toRoman(int value, bool upper)
+{
+    static const int values[] = {1000, 900, 500, 400, 100, 90, 50, 40, 10, 9, 5, 4, 1};
+    static const char *const digits[] = {"m", "cm", "d", "cd", "c", "xc", "l", "xl", "x", "ix", "v", "iv", "i"};
+    std::string result;
+    for (int i = 0; i < 13 && value > 0; ++i)
+    {
+        for (; value >= values[i]; value -= values[i])
+            result += digits[i];
+    }
+    if (upper)
+    {
+        for (char &c : result)
+            c = static_cast<char>(c - 'a' + 'A');
+    }
+    return result;
+}
+
+// One level's number in its w:numFmt. Letters and roman numerals grow with
+// the value, past Word's limit it is written in decimal.
+static std::string formatNumber(int value, const std::string &format)
+{
+    if (value > MAX_LIST_NUMBER)
+    {
+        return std::to_string(value);
+    }
+    if ((format == "lowerLetter" || format == "upperLetter") && value > 0)
+    {
+        // a..z, then aa..zz as Word does
+        int index = (value - 1) % 26;
+        std::string letters(static_cast<size_t>((value - 1) / 26 + 1), static_cast<char>('a' + index));
+        if (format == "upperLetter")
+        {
+            for (char &c : letters)
+                c = static_cast<char>(c - 'a' + 'A');
+        }
+        return letters;
+    }
+    if ((format == "lowerRoman" || format == "upperRoman") && value > 0)
+    {
+        return toRoman(value, format == "upperRoman");
+    }
+    if (format == "decimalZero" && value < 10)
+    {
+        return "0" + std::to_string(value);
+    }
+    return std::to_string(value);
+}
+
+std::string ListCounters::next(NumberingRef ref)
+{
+    const std::array<StyleTable::Level, StyleTable::MAX_LEVELS> *levels = styles_.levels(ref.numId);
+    if (!levels || ref.level < 0 || ref.level >= StyleTable::MAX_LEVELS)
+        return std::string();
+
+    // Advancing a level restarts every level below it. Not started is its own
+    // value, a list may well start at 0.
+    auto inserted = counts_.try_emplace(ref.numId);
+    std::array<int, StyleTable::MAX_LEVELS> &counts = inserted.first->second;
+    if (inserted.second)
+        counts.fill(NOT_STARTED);
+    counts[ref.level] = counts[ref.level] != NOT_STARTED ? counts[ref.level] + 1 : (*levels)[ref.level].start;
+    for (int deeper = ref.level + 1; deeper < StyleTable::MAX_LEVELS; ++deeper)
+        counts[deeper] = NOT_STARTED;
+
+    const StyleTable::Level &level = (*levels)[ref.level];
+    if (level.format == "none")
+        return std::string();
+    if (level.format == "bullet")
+    {
+        // Bullets are usually Symbol or Wingdings code points in the private
+        // use area, which the DejaVu faces don't have
+        unsigned char lead = level.text.empty() ? 0 : static_cast<unsigned char>(level.text[0]);
+        return level.text.empty() || lead == 0xEF ? "•" : level.text;
+    }
+
+    // %1..%9 stand for the counters of those levels
+    std::string marker;
+    for (size_t i = 0; i < level.text.size(); ++i)
+    {
+        char c = level.text[i];
+        if (c == '%' && i + 1 < level.text.size() && level.text[i + 1] >= '1' && level.text[i + 1] <= '9')
+        {
+            int shown = level.text[++i] - '1';
+            int count = counts[shown] != NOT_STARTED ? counts[shown] : (*levels)[shown].start;
+            marker += formatNumber(count, (*levels)[shown].format);
+        }
+        else
+        {
+            marker += c;
+        }
+    }
+    return marker;
+}
@@ -0,0 +1,177 @@
+#include "TextTokenizer.h"
+#include "LineBreak.h"
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TOKENIZER_BLOCK 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TOKENIZER_BLOCK 16
+#endif
+
+// Tab, newline, vertical tab, form feed, carriage return and space, what
+// isspace() accepts in the C locale
+static inline bool isAsciiSpace(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Length of the breaking Unicode space at p, 0 if there is none. All of them
+// are three bytes long with a lead byte from 0xE1 to 0xE3.
+static inline size_t unicodeSpaceLength(const unsigned char *p, size_t available)
+{
+    if (available < 3)
+        return 0;
+    if (p[0] == 0xE1)
+        return p[1] == 0x9A && p[2] == 0x80 ? 3 : 0; // U+1680
+    if (p[0] == 0xE3)
+        return p[1] == 0x80 && p[2] == 0x80 ? 3 : 0; // U+3000
+    if (p[0] != 0xE2)
+        return 0;
+    if (p[1] == 0x80)
+    {
+        // U+2000-U+200A except the figure space U+2007, U+2028, U+2029
+        return (p[2] >= 0x80 && p[2] <= 0x8A && p[2] != 0x87) || p[2] == 0xA8 || p[2] == 0xA9 ? 3 : 0;
+    }
+    return p[1] == 0x81 && p[2] == 0x9F ? 3 : 0; // U+205F
+}
+
+static inline bool startsSpace(const unsigned char *p, size_t available)
+{
+    return isAsciiSpace(p[0]) || (p[0] >= 0xE1 && p[0] <= 0xE3 && unicodeSpaceLength(p, available) != 0);
+}
+
+#ifdef TOKENIZER_BLOCK
+// Per-byte masks of one block. A byte x lies in [low, low + span] exactly when
+// (x - low) saturating-minus span is zero, which covers the unsigned ranges
+// SSE2's signed compares can't express directly.
+#if TOKENIZER_BLOCK == 32
+typedef __m256i Block;
+static inline Block loadBlock(const unsigned char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+static inline Block inRange(Block bytes, char low, char span)
+{
+    Block offset = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_subs_epu8(offset, _mm256_set1_epi8(span)), _mm256_setzero_si256());
+}
+static inline Block equal(Block bytes, char c) { return _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)); }
+static inline Block either(Block a, Block b) { return _mm256_or_si256(a, b); }
+static inline Block without(Block a, Block b) { return _mm256_andnot_si256(b, a); }
+static inline uint32_t bits(Block mask) { return static_cast<uint32_t>(_mm256_movemask_epi8(mask)); }
+static const uint32_t ALL_BITS = 0xFFFFFFFFu;
+#else
+typedef __m128i Block;
+static inline Block loadBlock(const unsigned char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+static inline Block inRange(Block bytes, char low, char span)
+{
+    Block offset = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_subs_epu8(offset, _mm_set1_epi8(span)), _mm_setzero_si128());
+}
+static inline Block equal(Block bytes, char c) { return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)); }
+static inline Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+static inline Block without(Block a, Block b) { return _mm_andnot_si128(b, a); }
+static inline uint32_t bits(Block mask) { return static_cast<uint32_t>(_mm_movemask_epi8(mask)); }
+static const uint32_t ALL_BITS = 0xFFFFu;
+#endif
+
+// Bytes that may end a word: ASCII whitespace and the lead bytes of the Unicode spaces
+static inline uint32_t wordBreaks(const unsigned char *p)
+{
+    Block bytes = loadBlock(p);
+    Block ascii = either(equal(bytes, ' '), inRange(bytes, '\t', '\r' - '\t'));
+    return bits(either(ascii, inRange(bytes, static_cast<char>(0xE1), 2)));
+}
+
+// Bytes that continue a run of ASCII spaces, anything but '\n'
+static inline uint32_t asciiSpaces(const unsigned char *p)
+{
+    Block bytes = loadBlock(p);
+    Block ascii = either(equal(bytes, ' '), inRange(bytes, '\t', '\r' - '\t'));
+    return bits(without(ascii, equal(bytes, '\n')));
+}
+#endif
+
+// End of the word starting before pos
+static size_t wordEnd(const unsigned char *s, size_t pos, size_t len)
+{
+    while (pos < len)
+    {
+#ifdef TOKENIZER_BLOCK
+        if (len - pos >= TOKENIZER_BLOCK)
+        {
+            uint32_t candidates = wordBreaks(s + pos);
+            if (candidates == 0)
+            {
+                pos += TOKENIZER_BLOCK;
+                continue;
+            }
+            pos += __builtin_ctz(candidates);
+        }
+#endif
+        // Confirm the candidate, a lead byte may start any other character (an em dash, a quote)
+        if (startsSpace(s + pos, len - pos))
+            return pos;
+        pos++;
+    }
+    return len;
+}
+
+// End of the run of spaces starting at pos, a newline ends it
+static size_t spaceEnd(const unsigned char *s, size_t pos, size_t len)
+{
+    while (pos < len)
+    {
+#ifdef TOKENIZER_BLOCK
+        if (len - pos >= TOKENIZER_BLOCK)
+        {
+            uint32_t others = ~asciiSpaces(s + pos) & ALL_BITS;
+            if (others == 0)
+            {
+                pos += TOKENIZER_BLOCK;
+                continue;
+            }
+            pos += __builtin_ctz(others);
+        }
+#endif
+        if (s[pos] != '\n' && isAsciiSpace(s[pos]))
+        {
+            pos++;
+            continue;
+        }
+        size_t length = unicodeSpaceLength(s + pos, len - pos);
+        if (length == 0)
+            return pos;
+        pos += length;
+    }
+    return len;
+}
+
+bool TextTokenizer::next(TextToken &token)
+{
+    size_t len = text_.size();
+    if (pos_ >= len)
+        return false;
+
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(text_.data());
+    size_t start = pos_;
+    if (s[start] == '\n')
+    {
+        token.kind = TextToken::NEWLINE;
+        pos_ = start + 1;
+    }
+    else if (startsSpace(s + start, len - start))
+    {
+        token.kind = TextToken::SPACE;
+        pos_ = spaceEnd(s, start, len);
+    }
+    else
+    {
+        token.kind = TextToken::WORD;
+        // The word's end is found once, its pieces are cut from it afterwards
+        if (wordEnd_ <= start)
+            wordEnd_ = wordEnd(s, start + 1, len);
+        pos_ = start + unbreakablePrefix(text_.substr(start, wordEnd_ - start));
+    }
+    token.text = text_.substr(start, pos_ - start);
+    return true;
+}
@@ -0,0 +1,226 @@
+#include "ThreadPool.h"
+#include "Diagnostics.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+
+// Lets submit() recognise calls made from one of the pool's own workers
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        queues_.emplace_back(new WorkQueue);
+    }
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_++;
+        index = currentPool == this ? currentWorker : nextQueue_++ % queues_.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+    }
+    wake_.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool ThreadPool::takeTask(size_t index, std::function<void()> &task)
+{
+    // Own deque first, newest task (its data is most likely still in cache)
+    {
+        WorkQueue &own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+
+    // Otherwise steal the oldest task from another worker
+    for (size_t i = 1; !task && i < queues_.size(); ++i)
+    {
+        WorkQueue &victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_--;
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    for (;;)
+    {
+        std::function<void()> task;
+        if (takeTask(index, task))
+        {
+            try
+            {
+                task();
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Unhandled exception in worker thread: " << e.what() << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0)
+            {
+                idle_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+        if (stopping_ && queued_ <= 0)
+        {
+            return;
+        }
+    }
+}
+
+ThreadPool *helperPool()
+{
+    size_t cores = std::thread::hardware_concurrency();
+    if (cores < 2 || (currentPool && currentPool->size() > 1))
+    {
+        return nullptr;
+    }
+
+    // Created on first use, the caller is the extra core
+    static ThreadPool helpers(cores - 1);
+    return &helpers;
+}
+
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &body)
+{
+    size_t cores = std::thread::hardware_concurrency();
+    grain = std::max<size_t>(grain, 1);
+    ThreadPool *helpers = count > grain ? helperPool() : nullptr;
+    if (!helpers)
+    {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+
+    // A few chunks per core so an uneven chunk doesn't leave the others idle
+    size_t chunkCount = std::min((count + grain - 1) / grain, cores * 4);
+    size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+    chunkCount = (count + chunkSize - 1) / chunkSize;
+
+    // Helper tasks may start after the loop is done, so they hold the state
+    // themselves and only touch body while there are chunks left to claim
+    struct State
+    {
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t done = 0;
+        std::exception_ptr error; // the first chunk that threw, rethrown by the caller
+    };
+    auto state = std::make_shared<State>();
+
+    // Problems found by a helper belong to the caller's conversion
+    Diagnostics *diagnostics = currentDiagnostics();
+    auto work = [state, &body, count, chunkSize, chunkCount, diagnostics]() {
+        DiagnosticsScope scope(diagnostics);
+        for (size_t chunk; (chunk = state->next++) < chunkCount;)
+        {
+            // A chunk that throws still counts as done, or the caller would
+            // wait forever. Once one has thrown the remaining ones are skipped.
+            std::exception_ptr error;
+            if (!state->failed)
+            {
+                size_t begin = chunk * chunkSize;
+                try
+                {
+                    body(begin, std::min(count, begin + chunkSize));
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                    state->failed = true;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (error && !state->error)
+                state->error = error;
+            if (++state->done == chunkCount)
+                state->finished.notify_all();
+        }
+    };
+
+    for (size_t i = 1; i < std::min(chunkCount, cores); ++i)
+    {
+        helpers->submit(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&]() { return state->done == chunkCount; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
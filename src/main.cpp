@@ -1,6 +1,21 @@
 #include <iostream>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <unistd.h>
+#include "BatchConverter.h"
+#include "ConversionServer.h"
 #include "DocxParser.h"
 #include "DocxToPdfConverter.h"
+#include "LayoutCache.h"
+#include "Metrics.h"
+#include "ResultCache.h"
 
 // expands the ~ directory since cpp doesn't do it like shell
 std::string expand_home_directory(const std::string &path)
@@ -16,7 +31,80 @@ std::string expand_home_directory(const std::string &path)
     return path;
 }
 
-int main()
+void print_usage(const char *program)
+{
+    std::cerr << "Usage:\n"
+              << "  " << program << "                                 convert example.docx in the workspace\n"
+              << "  " << program << " <input.docx> <output.pdf> [--metrics <file|->]\n"
+              << "        [--cache <dir>] [--cache-size MB]\n"
+              << "  " << program << " <input.docx|-> <output.pdf|-> [--metrics <file|->]   - is stdin/stdout\n"
+              << "  " << program << " --batch <dir|glob|@manifest> <output_dir> [--jobs N] [--metrics <file|->]\n"
+              << "        [--cache <dir>] [--cache-size MB] [--layout-cache MB]\n"
+              << "  " << program << " --serve <socket> [--jobs N] [--queue N] [--cache <dir>] [--cache-size MB]\n"
+              << "        [--layout-cache MB]\n"
+              << "  " << program << " --client <socket> <input.docx> <output.pdf> [--by-path]\n";
+}
+
+// Upper bounds of the numeric options. Sizes in MB are converted to bytes.
+const size_t MAX_JOBS = 4096;
+const size_t MAX_QUEUED = 1 << 20;
+const uint64_t MAX_MB = UINT64_MAX / (1024 * 1024);
+
+// Reads the value of a numeric option: decimal digits only, at most max.
+// Anything else ("8x", "-1", "", an overflow) is reported and rejected.
+template <typename T>
+bool parse_number(const char *option, const char *text, T max, T &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long parsed = isdigit(static_cast<unsigned char>(text[0])) ? std::strtoull(text, &end, 10) : 0;
+    if (!end || *end != '\0' || errno == ERANGE || parsed > max)
+    {
+        std::cerr << option << " takes a number from 0 to " << max << ", not '" << text << "'" << std::endl;
+        return false;
+    }
+    value = static_cast<T>(parsed);
+    return true;
+}
+
+// Default bound of the result cache when --cache-size isn't given
+const uint64_t DEFAULT_CACHE_MB = 1024;
+
+// Handles --cache and --cache-size at argv[i], returns false for any other
+// option or an invalid size
+bool parse_cache_option(int argc, char **argv, int &i, std::string &cache_dir, uint64_t &cache_mb)
+{
+    if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+    {
+        cache_dir = expand_home_directory(argv[++i]);
+        return true;
+    }
+    if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+    {
+        bool valid = parse_number(argv[i], argv[i + 1], MAX_MB, cache_mb);
+        ++i;
+        return valid;
+    }
+    return false;
+}
+
+// Layout cache size in server mode, where drafts of the same document come back
+const uint64_t DEFAULT_SERVER_LAYOUT_CACHE_MB = 128;
+
+void print_layout_cache_stats()
+{
+    if (LayoutCache *cache = LayoutCache::instance())
+    {
+        LayoutCache::Stats s = cache->stats();
+        uint64_t lookups = s.hits + s.misses;
+        std::cout << std::fixed << std::setprecision(1) << "Layout cache: " << s.hits << " hits, " << s.misses
+                  << " misses (" << (lookups ? 100.0 * s.hits / lookups : 0.0) << "% hit rate), " << s.evictions
+                  << " evicted, " << s.entries << " blocks using " << s.bytes / (1024.0 * 1024.0) << " MB"
+                  << std::endl;
+    }
+}
+
+int run_default()
 {
     std::string base_dir; 
 
@@ -31,21 +119,282 @@ int main()
         #error "Unsupported operating system"
     #endif
 
-    // TODO: Hardcoded for now but should ask for user input, could handle this on the cloud as a future addition
     std::string docx_file = expand_home_directory(base_dir + "/example.docx");
-    std::string output_dir = expand_home_directory(base_dir + "/outdir");
     std::string output_pdf = expand_home_directory(base_dir + "/output.pdf");
 
-    if (unzip_docx(docx_file, output_dir))
+    // Parts are decompressed into memory on demand, no outdir round trip
+    DocxArchive archive;
+    if (archive.open(docx_file))
     {
-        std::cout << "DOCX file successfully unzipped!" << std::endl;
-        generatePDF(output_dir, output_pdf);
-        std::cout << "PDF file successfully generated!" << std::endl;
+        std::cout << "DOCX file successfully opened!" << std::endl;
+        if (generatePDF(archive, output_pdf))
+        {
+            std::cout << "PDF file successfully generated!" << std::endl;
+        }
     }
     else
     {
-        std::cerr << "Failed to unzip DOCX file!" << std::endl;
+        std::cerr << "Failed to open DOCX file!" << std::endl;
+    }
+
+    return 0;
+}
+
+// Runs jobs through run_batch, with a result cache when cache_dir is set
+int run_batch_jobs(const std::vector<BatchJob> &batch, size_t jobs, const std::string &metrics_path,
+                   const std::string &cache_dir, uint64_t cache_mb)
+{
+    std::unique_ptr<ResultCache> cache;
+    if (!cache_dir.empty())
+    {
+        cache.reset(new ResultCache(cache_dir, cache_mb * 1024 * 1024));
+        if (!cache->open())
+        {
+            return 1;
+        }
+    }
+    return run_batch(batch, jobs, metrics_path, cache.get()) == 0 ? 0 : 1;
+}
+
+int run_batch_mode(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string source = expand_home_directory(argv[2]);
+    std::string output_dir = expand_home_directory(argv[3]);
+    size_t jobs = 0;
+    std::string metrics_path;
+    std::string cache_dir;
+    uint64_t cache_mb = DEFAULT_CACHE_MB;
+    uint64_t layout_cache_mb = 0;
+
+    for (int i = 4; i < argc; ++i)
+    {
+        bool valid = true;
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            valid = parse_number(argv[i], argv[i + 1], MAX_JOBS, jobs);
+            ++i;
+        }
+        else if (strcmp(argv[i], "--layout-cache") == 0 && i + 1 < argc)
+        {
+            valid = parse_number(argv[i], argv[i + 1], MAX_MB, layout_cache_mb);
+            ++i;
+        }
+        else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+        {
+            metrics_path = argv[++i];
+        }
+        else
+        {
+            valid = parse_cache_option(argc, argv, i, cache_dir, cache_mb);
+        }
+
+        if (!valid)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<BatchJob> batch;
+    if (!collect_batch_jobs(source, output_dir, batch))
+    {
+        return 1;
+    }
+
+    LayoutCache::enable(layout_cache_mb * 1024 * 1024);
+    int status = run_batch_jobs(batch, jobs, metrics_path, cache_dir, cache_mb);
+    print_layout_cache_stats();
+    return status;
+}
+
+// Converts with "-" standing for stdin and/or stdout. Nothing is written to a
+// temporary file, and with the PDF on stdout every message goes to stderr.
+int run_pipe_mode(const std::string &input, const std::string &output, const std::string &metrics_path)
+{
+    ConversionMetrics metrics;
+    bool ok;
+    {
+        MetricsScope scope(metrics_path.empty() ? nullptr : &metrics);
+
+        // The archive reads straight out of this buffer, so it has to outlive the conversion
+        std::string docx_bytes;
+        DocxArchive archive;
+        if (input == "-")
+        {
+            std::stringstream buffer;
+            buffer << std::cin.rdbuf();
+            docx_bytes = buffer.str();
+            ok = archive.openFromBuffer(docx_bytes);
+        }
+        else
+        {
+            ok = archive.open(input);
+        }
+
+        if (ok && output == "-")
+        {
+            ok = generatePDFToFd(archive, STDOUT_FILENO);
+        }
+        else if (ok)
+        {
+            ok = generatePDF(archive, output);
+        }
+    }
+    if (ok && output != "-")
+    {
+        std::cout << "PDF saved successfully to " << output << std::endl;
+    }
+
+    if (!metrics_path.empty())
+    {
+        std::ofstream metrics_file;
+        if (metrics_path != "-")
+        {
+            metrics_file.open(metrics_path);
+            if (!metrics_file.is_open())
+            {
+                std::cerr << "Failed to open metrics file " << metrics_path << std::endl;
+                return 1;
+            }
+        }
+        std::ostream &out = metrics_path == "-" ? std::cerr : metrics_file;
+        metrics.writeJson(out);
+        out << std::endl;
     }
+    return ok ? 0 : 1;
+}
 
+int run_server_mode(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    ServerOptions options;
+    options.socketPath = expand_home_directory(argv[2]);
+    uint64_t cache_mb = DEFAULT_CACHE_MB;
+    uint64_t layout_cache_mb = DEFAULT_SERVER_LAYOUT_CACHE_MB;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        bool valid = true;
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            valid = parse_number(argv[i], argv[i + 1], MAX_JOBS, options.threads);
+            ++i;
+        }
+        else if (strcmp(argv[i], "--layout-cache") == 0 && i + 1 < argc)
+        {
+            valid = parse_number(argv[i], argv[i + 1], MAX_MB, layout_cache_mb);
+            ++i;
+        }
+        else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc)
+        {
+            valid = parse_number(argv[i], argv[i + 1], MAX_QUEUED, options.maxQueued);
+            ++i;
+        }
+        else
+        {
+            valid = parse_cache_option(argc, argv, i, options.cacheDir, cache_mb);
+        }
+
+        if (!valid)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    options.cacheBytes = cache_mb * 1024 * 1024;
+
+    LayoutCache::enable(layout_cache_mb * 1024 * 1024);
+    ConversionServer server(options);
+    bool ok = server.run();
+    print_layout_cache_stats();
+    return ok ? 0 : 1;
+}
+
+int run_client_mode(int argc, char **argv)
+{
+    bool by_path = argc == 6 && strcmp(argv[5], "--by-path") == 0;
+    if (argc != 5 && !by_path)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string output = expand_home_directory(argv[4]);
+    if (!request_conversion(expand_home_directory(argv[2]), expand_home_directory(argv[3]), output, !by_path))
+    {
+        return 1;
+    }
+    std::cout << "PDF saved successfully to " << output << std::endl;
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    // No arguments keeps the original behaviour of converting the workspace example
+    if (argc == 1)
+    {
+        return run_default();
+    }
+
+    if (strcmp(argv[1], "--batch") == 0)
+    {
+        return run_batch_mode(argc, argv);
+    }
+
+    if (strcmp(argv[1], "--serve") == 0)
+    {
+        return run_server_mode(argc, argv);
+    }
+
+    if (strcmp(argv[1], "--client") == 0)
+    {
+        return run_client_mode(argc, argv);
+    }
+
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string metrics_path;
+    std::string cache_dir;
+    uint64_t cache_mb = DEFAULT_CACHE_MB;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+        {
+            metrics_path = argv[++i];
+        }
+        else if (!parse_cache_option(argc, argv, i, cache_dir, cache_mb))
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (strcmp(argv[1], "-") == 0 || strcmp(argv[2], "-") == 0)
+    {
+        if (!cache_dir.empty())
+        {
+            std::cerr << "--cache needs file paths, not stdin/stdout" << std::endl;
+            return 1;
+        }
+        return run_pipe_mode(expand_home_directory(argv[1]), expand_home_directory(argv[2]), metrics_path);
+    }
+
+    // A single file is just the degenerate case of a batch
+    std::vector<BatchJob> batch = {{expand_home_directory(argv[1]), expand_home_directory(argv[2])}};
+    return run_batch_jobs(batch, 1, metrics_path, cache_dir, cache_mb);
+}